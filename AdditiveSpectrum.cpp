@@ -1,11 +1,12 @@
-#include <juce_gui_extra/juce_gui_extra.h>
+#include <juce_data_structures/juce_data_structures.h>
 
 #include "AdditiveSpectrum.h"
-#include "TimeSlider.h"
+#include "KeyFrameCodec.h"
+#include "Tracer.h"
 
 AdditiveSpectrum::AdditiveSpectrum(int nFreqs, float noteFreq, float duration, int nKeyFrames)
         : Spectrum(nFreqs, duration), noteFreq(noteFreq),
-          nKeyFrames(nKeyFrames), keyFrameIndex(0), copiedKeyFrame(nullptr),
+          nKeyFrames(nKeyFrames), copiedKeyFrame(nullptr),
           timeFloatEpsilon(duration/(2*4*(nKeyFrames)))
 {
     jassert(nKeyFrames > 0);
@@ -17,15 +18,15 @@ AdditiveSpectrum::AdditiveSpectrum(int nFreqs, float noteFreq, float duration, i
     }
 
     // Set first keyframe to active, initialising its spectrum to all 0s:
-    keyFrames[keyFrameIndex]->setActive();
-    keyFrames[keyFrameIndex]->refreshKFLinks();
+    keyFrames[0]->setActive();
+    keyFrames[0]->refreshKFLinks();
 }
 
 // Logarithmically scale frequencies to ensure less freqs within lower range of human hearing.
 float AdditiveSpectrum::getFrequency(int freqIndex)
 {
     //TODO pow(2.0, (inputFreq - noteFreq));
-    return noteFreq * (float) (freqIndex+1);
+    return noteFreq.load(std::memory_order_relaxed) * (float) (freqIndex+1);
 }
 
 void AdditiveSpectrum::setFirstFrequency(float freq)
@@ -35,35 +36,76 @@ void AdditiveSpectrum::setFirstFrequency(float freq)
 
 void AdditiveSpectrum::setMagnitude(int fIndex, float mag)
 {
-    if (playState != PlayingSound)
+    if (auto kf = getEditableKeyFrame())
     {
-        playState = EditingSpectrum;
-        auto kf = keyFrames[keyFrameIndex];
-        if(keyFrameExists(keyFrameIndex))
-        {
-            if (!kf->getIsActive())
-            {
-                kf->copyFrom(kf->getPrevActive(), time);
-                kf->setActive();
-                kf->refreshKFLinks();
-            }
-            kf->setMagnitude(fIndex, mag);
-        }
+        kf->setMagnitude(fIndex, mag);
+        if (onEdited) onEdited();
     }
 }
 
+void AdditiveSpectrum::setMagnitudes(int firstIndex, const float* mags, int n)
+{
+    if (auto kf = getEditableKeyFrame())
+    {
+        for (int i=0; i<n; i++) kf->setMagnitude(firstIndex + i, mags[i]);
+        if (onEdited) onEdited();
+    }
+}
+
+// Returns the keyframe at the time cursor, activating it first if needed. Returns nullptr whilst playing.
+AdditiveSpectrum::KeyFrame* AdditiveSpectrum::getEditableKeyFrame()
+{
+    if (getPlayState() == PlayingSound) return nullptr;
+
+    changePlayState(Stopped, EditingSpectrum);
+    const float t = time;
+    const int index = getKeyFrameIndex(t);
+    if(!keyFrameExists(index)) return nullptr;
+    auto kf = keyFrames[index];
+
+    if (!kf->getIsActive())
+    {
+        kf->copyFrom(kf->getPrevActive(), t);
+        kf->setActive();
+        kf->refreshKFLinks();
+    }
+    return kf;
+}
+
 float AdditiveSpectrum::getMagnitude(int fIndex)
 {
-    if(keyFrameExists(keyFrameIndex))
-        return keyFrames[keyFrameIndex]->getMagnitude(fIndex, time);
+    const float t = time;
+    const int index = getKeyFrameIndex(t);
+    if(keyFrameExists(index))
+        return keyFrames[index]->getMagnitude(fIndex, t);
     return 0.0f;
 }
 
+void AdditiveSpectrum::getMagnitudesAt(float t, float* magnitudes)
+{
+    const int index = juce::jlimit(0, nKeyFrames-1, juce::roundToInt<float>((t / duration)*(nKeyFrames-1)));
+    for (int i=0; i < nFreqs; i++) magnitudes[i] = keyFrames[index]->getMagnitude(i, t);
+}
+
 void AdditiveSpectrum::setTime(float t)
 {
-    if (playState == Stopped) playState = EditingSpectrum;
+    changePlayState(Stopped, EditingSpectrum);
     time = t;
-    keyFrameIndex = juce::roundToInt<float>((time / duration)*(nKeyFrames-1));
+}
+
+// Called by the audio thread once per block so envelope playback is independent of GUI load:
+void AdditiveSpectrum::advancePlayback(float seconds)
+{
+    auto word = playback.load();
+    if (getState(word) != PlayingSound) return;
+
+    float t = time.load();
+    float next = juce::jmin(t + seconds, duration);
+    // If the GUI has moved the cursor in the meantime (e.g. restarting playback) leave its time in place:
+    if (!time.compare_exchange_strong(t, next)) return;
+
+    // Only the audio thread ends a play, and fails to if play() has restarted it since:
+    if (next >= duration) playback.compare_exchange_strong(word, withState(word, Stopped));
 }
 
 void AdditiveSpectrum::updateKeyFrameTimes(juce::Array<float>& arrayOfKFTimes)
@@ -82,41 +124,77 @@ void AdditiveSpectrum::deleteKeyframe(float t)
 {
     int kFIndex = juce::roundToInt<float>((t / duration)*(nKeyFrames-1));
     if(keyFrameExists(kFIndex))
+    {
         keyFrames[kFIndex]->removeActive();
+        if (onEdited) onEdited();
+    }
 }
 
 void AdditiveSpectrum::copyKeyFrame()
 {
-    copiedKeyFrame = keyFrames[keyFrameIndex];
+    copiedKeyFrame = keyFrames[getKeyFrameIndex(time)];
 }
 
 void AdditiveSpectrum::pasteKeyFrame()
 {
-    if (copiedKeyFrame && keyFrameExists(keyFrameIndex))
+    const int index = getKeyFrameIndex(time);
+    if (copiedKeyFrame && keyFrameExists(index))
     {
-        auto kf = keyFrames[keyFrameIndex];
+        auto kf = keyFrames[index];
         kf->copyFrom(copiedKeyFrame, copiedKeyFrame->getTimeStamp());
         if (! kf->getIsActive())
         {
             kf->setActive();
             kf->refreshKFLinks();
         }
+        if (onEdited) onEdited();
     }
 }
 
 int AdditiveSpectrum::getNKeyFrames() {return nKeyFrames;}
 
+void AdditiveSpectrum::visitKeyFrameData(const std::function<void (void*, size_t)>& visitor)
+{
+    for (auto* kf : keyFrames)
+    {
+        auto& magnitudes = kf->getMagnitudes();
+        visitor(magnitudes.getRawDataPointer(), sizeof(float) * (size_t) magnitudes.size());
+    }
+}
+
 
 
-void AdditiveSpectrum::saveSpectrum(juce::FileOutputStream& outputStream)
+void AdditiveSpectrum::saveSpectrum(juce::OutputStream& outputStream, int compressedBits)
 {
     juce::ValueTree fileDataTree("SpectrumData");
     // Metadata:
     fileDataTree.setProperty("nKeyFrames", nKeyFrames, nullptr);
     fileDataTree.setProperty("nFreqs", nFreqs, nullptr);
     fileDataTree.setProperty("duration", duration, nullptr);
-    fileDataTree.setProperty("noteFreq", noteFreq, nullptr);
+    fileDataTree.setProperty("noteFreq", noteFreq.load(), nullptr);
     
+    if (KeyFrameCodec::isValidBits(compressedBits))
+    {
+        // Active keyframes' indexes and their magnitudes as two binary blobs:
+        juce::MemoryOutputStream indexes;
+        std::vector<float> magnitudes;
+        for (KeyFrame* kF = keyFrames[0]; kF != nullptr; kF = kF->getNextActive())
+        {
+            if (!kF->getIsActive()) continue;
+            indexes.writeInt(kF->getIndex());
+            magnitudes.insert(magnitudes.end(), kF->getMagnitudes().begin(), kF->getMagnitudes().begin() + nFreqs);
+        }
+        const int nActive = (int) magnitudes.size() / nFreqs;
+
+        juce::ValueTree compressedTree("CompressedKeyframeData");
+        compressedTree.setProperty("kFIndexes", indexes.getMemoryBlock(), nullptr);
+        if (nActive > 0)
+            compressedTree.setProperty("magnitudes", KeyFrameCodec::encode(magnitudes.data(), nActive, nFreqs, compressedBits), nullptr);
+        fileDataTree.addChild(compressedTree, -1, nullptr);
+        fileDataTree.writeToStream(outputStream);
+        return;
+    }
+
     // Keyframes:
     juce::ValueTree activeKeyframeTree("KeyframeData");
     KeyFrame* kF = keyFrames[0];
@@ -144,29 +222,40 @@ void AdditiveSpectrum::saveSpectrum(juce::FileOutputStream& outputStream)
 
     fileDataTree.writeToStream(outputStream);
 }
-void AdditiveSpectrum::loadSpectrum(juce::FileInputStream& inputStream)
+void AdditiveSpectrum::loadSpectrum(juce::InputStream& inputStream)
 {
+    ADDRSOUND_TRACE_SCOPE("AdditiveSpectrum::loadSpectrum");
+
     setTime(0.0f); // Reset time to the first 0th keyframe. Audio thread should thus not perform interpolation no matter how many keyframes are added/removed (Not guaranteed!)
 
     juce::ValueTree fileDataTree = juce::ValueTree::readFromStream(inputStream);
 
-    nKeyFrames = fileDataTree["nKeyFrames"];
-    nFreqs = fileDataTree["nFreqs"];
-    duration = fileDataTree["duration"];
-    noteFreq = fileDataTree["noteFreq"];
-    timeFloatEpsilon = duration/(2*4*(nKeyFrames));
-    
-    jassert(nKeyFrames > 0 && nFreqs > 0 && duration > 0.0f);
-    
-    
-    for (auto i=0; i < nKeyFrames; i++)
-    {   
-        if (i < keyFrames.size()) // Reset data of current keyframes:
-            keyFrames[i]->reset();
-        else // Allocate more keyframes if more are needed:
-            keyFrames.add(new KeyFrame(i, this));
+    resetKeyFrames(fileDataTree["nKeyFrames"], fileDataTree["nFreqs"], fileDataTree["duration"], fileDataTree["noteFreq"]);
+
+    juce::ValueTree compressedTree = fileDataTree.getChildWithName("CompressedKeyframeData");
+    if (compressedTree.isValid())
+    {
+        const juce::MemoryBlock* indexData = compressedTree["kFIndexes"].getBinaryData();
+        const juce::MemoryBlock* magnitudeData = compressedTree["magnitudes"].getBinaryData();
+        const int nActive = indexData != nullptr ? (int) indexData->getSize() / 4 : 0;
+        std::vector<float> magnitudes((size_t) nActive * (size_t) nFreqs);
+        if (nActive > 0 && magnitudeData != nullptr
+            && KeyFrameCodec::decode(*magnitudeData, magnitudes.data(), nActive, nFreqs))
+        {
+            juce::MemoryInputStream indexes(*indexData, false);
+            for (int a=0; a < nActive; a++)
+            {
+                const int kFIndex = indexes.readInt();
+                if (kFIndex < 0 || kFIndex >= nKeyFrames) continue;
+                KeyFrame* kf = keyFrames[kFIndex];
+                kf->setActive();
+                std::copy_n(magnitudes.begin() + a * nFreqs, nFreqs, kf->getMagnitudes().begin());
+            }
+        }
+        keyFrames[0]->refreshKFLinks();
+        return;
     }
-    
+
     // Load active keyframes:
     juce::ValueTree activeKeyframeTree = fileDataTree.getChildWithName("KeyframeData");
     for (juce::ValueTree keyframeData : activeKeyframeTree)
@@ -183,6 +272,98 @@ void AdditiveSpectrum::loadSpectrum(juce::FileInputStream& inputStream)
     keyFrames[0]->refreshKFLinks();
 }
 
+void AdditiveSpectrum::setKeyFrames(int newNFreqs, float newNoteFreq, float newDuration, int newNKeyFrames, const float* magnitudes)
+{
+    setTime(0.0f);
+    resetKeyFrames(newNKeyFrames, newNFreqs, newDuration, newNoteFreq);
+
+    for (int kFIndex=0; kFIndex < nKeyFrames; kFIndex++)
+    {
+        KeyFrame* kf = keyFrames[kFIndex];
+        kf->setActive();
+        for (int i=0; i < nFreqs; i++) kf->setMagnitude(i, magnitudes[kFIndex * nFreqs + i]);
+    }
+    keyFrames[0]->refreshKFLinks();
+}
+
+AdditiveSpectrum::SimplifyResult AdditiveSpectrum::simplifyKeyFrames(float tolerance)
+{
+    std::vector<KeyFrame*> active;
+    for (int i=0; i < nKeyFrames; i++)
+        if (keyFrames[i]->getIsActive()) active.push_back(keyFrames[i]);
+
+    SimplifyResult result {(int) active.size(), (int) active.size(), 0.0f};
+    if (active.size() < 3) return result;
+
+    // Largest difference, over all partials, between kf and the interpolation of left and right:
+    auto interpolationError = [this] (KeyFrame* left, KeyFrame* kf, KeyFrame* right) {
+        const float fraction = (kf->getTimeStamp() - left->getTimeStamp()) / (right->getTimeStamp() - left->getTimeStamp());
+        const float* l = left->getMagnitudes().getRawDataPointer();
+        const float* m = kf->getMagnitudes().getRawDataPointer();
+        const float* r = right->getMagnitudes().getRawDataPointer();
+        float error = 0.0f;
+        for (int i=0; i < nFreqs; i++)
+            error = juce::jmax(error, std::abs(m[i] - (l[i] + fraction * (r[i] - l[i]))));
+        return error;
+    };
+
+    std::vector<bool> keep(active.size(), false);
+    keep.front() = keep.back() = true;
+    std::vector<std::pair<size_t, size_t>> segments {{0, active.size() - 1}};
+    while (!segments.empty())
+    {
+        auto segment = segments.back();
+        segments.pop_back();
+
+        size_t worst = segment.first;
+        float worstError = 0.0f;
+        for (size_t i = segment.first + 1; i < segment.second; i++)
+        {
+            const float error = interpolationError(active[segment.first], active[i], active[segment.second]);
+            if (error > worstError) {worst = i; worstError = error;}
+        }
+
+        if (worstError > tolerance) // Keep the worst keyframe and simplify either side of it
+        {
+            keep[worst] = true;
+            segments.push_back({segment.first, worst});
+            segments.push_back({worst, segment.second});
+        }
+        else // Everything in between is dropped
+            result.maxError = juce::jmax(result.maxError, worstError);
+    }
+
+    for (size_t i=0; i < active.size(); i++)
+    {
+        if (keep[i]) continue;
+        active[i]->removeActive(false);
+        result.nAfter--;
+    }
+    keyFrames[0]->refreshKFLinks();
+    return result;
+}
+
+// Resizes to the given shape, with every keyframe inactive and silent
+void AdditiveSpectrum::resetKeyFrames(int newNKeyFrames, int newNFreqs, float newDuration, float newNoteFreq)
+{
+    nKeyFrames = newNKeyFrames;
+    nFreqs = newNFreqs;
+    duration = newDuration;
+    noteFreq = newNoteFreq;
+    timeFloatEpsilon = duration/(2*4*(nKeyFrames));
+    
+    jassert(nKeyFrames > 0 && nFreqs > 0 && duration > 0.0f);
+    
+    
+    for (auto i=0; i < nKeyFrames; i++)
+    {   
+        if (i < keyFrames.size()) // Reset data of current keyframes:
+            keyFrames[i]->reset();
+        else // Allocate more keyframes if more are needed:
+            keyFrames.add(new KeyFrame(i, this));
+    }
+}
+
 
 
 
@@ -294,13 +475,13 @@ void AdditiveSpectrum::KeyFrame::setActive()
     isActive = true;
 }
 
-void AdditiveSpectrum::KeyFrame::removeActive()
+void AdditiveSpectrum::KeyFrame::removeActive(bool refreshLinks)
 {
     if (isActive)
     {
         for (float& val : magnitudes) val = 0.0f;
         isActive = false;
-        refreshKFLinks();
+        if (refreshLinks) refreshKFLinks();
     }
 }
 
@@ -332,7 +513,7 @@ void AdditiveSpectrum::KeyFrame::refreshKFLinks()
     }
 
     // Refresh GUI to include keyframe markers:
-    if (spectrum && spectrum->timeSlider) spectrum->timeSlider->refreshKeyFrameMarkers();
+    if (spectrum && spectrum->onKeyFramesChanged) spectrum->onKeyFramesChanged();
 }
 
 inline float AdditiveSpectrum::KeyFrame::interpolate(int fIndex, float atTime, KeyFrame* left, KeyFrame* right)
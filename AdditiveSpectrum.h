@@ -1,11 +1,9 @@
 #pragma once
 
-#include <juce_gui_extra/juce_gui_extra.h>
+#include <juce_core/juce_core.h>
 
 #include "Spectrum.h"
 
-class TimeSlider;
-
 class AdditiveSpectrum : public Spectrum
 {
 public:
@@ -16,20 +14,43 @@ public:
     void setFirstFrequency(float freq);
 
     void setMagnitude(int fIndex, float mag) override;
+    void setMagnitudes(int firstIndex, const float* mags, int n) override;
     float getMagnitude(int fIndex) override;
+    void getMagnitudesAt(float t, float* magnitudes); // Every partial at time t, leaving the cursor where it is
 
     void setTime(float t) override;
+    void advancePlayback(float seconds); // Audio thread playback clock
 
     int getNKeyFrames();
 
-    TimeSlider* timeSlider = nullptr;
+    std::function<void()> onKeyFramesChanged; // Message thread, e.g. to redraw the keyframe markers
+    std::function<void()> onEdited; // Message thread, after magnitudes are edited or keyframes deleted or pasted
     void updateKeyFrameTimes(juce::Array<float>& arrayOfKFTimes);
     void deleteKeyframe(float t);
     void copyKeyFrame();
     void pasteKeyFrame();
 
-    void saveSpectrum(juce::FileOutputStream& outputStream);
-    void loadSpectrum(juce::FileInputStream& inputStream);
+    // Calls visitor with the raw magnitude storage of every keyframe (e.g. to prefault it)
+    void visitKeyFrameData(const std::function<void (void*, size_t)>& visitor);
+
+    // compressedBits 8, 12 or 16 stores the keyframes with KeyFrameCodec, 0 as plain properties;
+    // loadSpectrum reads either
+    void saveSpectrum(juce::OutputStream& outputStream, int compressedBits = 0);
+    void loadSpectrum(juce::InputStream& inputStream);
+    // Replaces the whole spectrum with nKeyFrames active keyframes of nFreqs magnitudes each
+    // (keyframe-major), e.g. from analysis. Like loadSpectrum, the audio thread must be stopped.
+    void setKeyFrames(int nFreqs, float noteFreq, float duration, int nKeyFrames, const float* magnitudes);
+
+    // Removes active keyframes that interpolating between the remaining ones reproduces to within
+    // tolerance for every partial (Ramer-Douglas-Peucker over all magnitudes at once). The first
+    // and last keyframes are kept. Like loadSpectrum, the audio thread must be stopped.
+    struct SimplifyResult
+    {
+        int nBefore, nAfter;
+        float maxError; // largest magnitude difference introduced
+        float getCompressionRatio() const {return nAfter > 0 ? (float) nBefore / (float) nAfter : 1.0f;}
+    };
+    SimplifyResult simplifyKeyFrames(float tolerance);
 
 private:
 
@@ -50,11 +71,12 @@ private:
         void copyFrom(KeyFrame* toCopy, float t);
 
         void setActive();
-        void removeActive();
+        void removeActive(bool refreshLinks = true);
         bool getIsActive();
 
         void refreshKFLinks();
         void reset();
+        juce::Array<float>& getMagnitudes() {return magnitudes;}
 
     private:
         juce::Array<float> magnitudes;
@@ -70,12 +92,17 @@ private:
     
     int nKeyFrames;
     juce::OwnedArray<KeyFrame> keyFrames;
-    int keyFrameIndex;
+    // The keyframe nearest time t. Derived from the time on every read, so the index can't
+    // disagree with a time that the GUI and the audio thread both write:
+    int getKeyFrameIndex(float t) const {return juce::roundToInt<float>((t / duration)*(nKeyFrames-1));}
     KeyFrame* copiedKeyFrame;
 
-    float noteFreq;
+    std::atomic<float> noteFreq; // Read by the audio thread, set by the message and MIDI threads
 
     float timeFloatEpsilon;
+
+    KeyFrame* getEditableKeyFrame();
+    void resetKeyFrames(int nKeyFrames, int nFreqs, float duration, float noteFreq);
     
     enum ErrorCode {KeyFrameOutOfBounds, NullKeyFrame, KeyFrameExists};
     inline void printError(int kFIndex, ErrorCode err)
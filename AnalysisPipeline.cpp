@@ -0,0 +1,327 @@
+#include "AnalysisPipeline.h"
+#include "FFTSpectrum.h"
+#include "Tracer.h"
+
+AnalysisPipeline::AnalysisPipeline(const Settings& s)
+    : settings(s), sampleRate(44100.0), cancelled(false), finished(true),
+      nSamplesDecoded(0), nFramesDone(0), startTicks(0), endTicks(0)
+{
+    jassert(juce::isPowerOfTwo(settings.nFreqs) && settings.windowSamples <= settings.nFreqs*2);
+
+    // Everything the stages work on is allocated here, once:
+    blockPool.resize((size_t) settings.queueDepth);
+    for (auto& block : blockPool) block.samples.resize((size_t) settings.decodeBlockSamples);
+
+    framePool.resize((size_t) (settings.queueDepth * (nStages - 2)));
+    for (auto& frame : framePool)
+    {
+        frame.signal.resize((size_t) settings.windowSamples);
+        frame.spectrum.resize((size_t) settings.nFreqs*2);
+        frame.magnitudes.resize((size_t) settings.nFreqs);
+        frame.peaks.indexs.reserve((size_t) settings.nFreqs);
+        frame.peaks.values.reserve((size_t) settings.nFreqs);
+    }
+    for (auto& ticks : busyTicks) ticks = 0;
+}
+
+AnalysisPipeline::~AnalysisPipeline()
+{
+    cancel();
+    stopThreads();
+}
+
+const char* AnalysisPipeline::getStageName(int stage)
+{
+    static const char* names[nStages] = {"decode", "decimate", "window", "FFT", "peak pick", "sink"};
+    return names[stage];
+}
+
+void AnalysisPipeline::start(juce::AudioFormatReader* newReader, Sink newSink)
+{
+    stopThreads();
+    reader.reset(newReader);
+    frameSink = std::move(newSink);
+    sampleRate = reader->sampleRate;
+
+    freeBlocks.reset((int) blockPool.size());
+    decodedBlocks.reset((int) blockPool.size());
+    for (auto& block : blockPool) freeBlocks.push(&block);
+    for (auto* queue : {&freeFrames, &decimatedFrames, &windowedFrames, &transformedFrames, &peakFrames})
+        queue->reset((int) framePool.size());
+    for (auto& frame : framePool) freeFrames.push(&frame);
+
+    cancelled = false;
+    finished.reset();
+    nSamplesDecoded = 0;
+    nFramesDone = 0;
+    for (auto& ticks : busyTicks) ticks = 0;
+    startTicks = juce::Time::getHighResolutionTicks();
+    endTicks = 0;
+
+    threads.emplace_back(new StageThread("Analysis decode", [this] {decode();}));
+    threads.emplace_back(new StageThread("Analysis decimate", [this] {decimate();}));
+    threads.emplace_back(new StageThread("Analysis window", [this] {window();}));
+    threads.emplace_back(new StageThread("Analysis FFT", [this] {fft();}));
+    threads.emplace_back(new StageThread("Analysis peaks", [this] {pickPeaks();}));
+    threads.emplace_back(new StageThread("Analysis sink", [this] {sink();}));
+    for (auto& thread : threads) thread->startThread();
+}
+
+void AnalysisPipeline::cancel()
+{
+    cancelled = true;
+    for (auto* queue : {&freeBlocks, &decodedBlocks})
+        queue->close();
+    for (auto* queue : {&freeFrames, &decimatedFrames, &windowedFrames, &transformedFrames, &peakFrames})
+        queue->close();
+    finished.signal();
+}
+
+void AnalysisPipeline::stop()
+{
+    if (!finished.wait(0)) cancel(); // Stages only exit at the end of the file or on cancel()
+    stopThreads();
+}
+
+bool AnalysisPipeline::waitForCompletion(int timeoutMs)
+{
+    return finished.wait(timeoutMs) && !cancelled;
+}
+
+void AnalysisPipeline::stopThreads()
+{
+    for (auto& thread : threads) thread->stopThread(-1); // Every stage exits on end of stream or cancel()
+    threads.clear();
+}
+
+float AnalysisPipeline::getFrequency(int index) const
+{
+    return (float) (index * (sampleRate/settings.downSamplingRate) / (settings.nFreqs*2));
+}
+
+//==============================================================================
+void AnalysisPipeline::decode()
+{
+    const juce::int64 length = reader->lengthInSamples;
+    const int channel = juce::jlimit(0, (int) reader->numChannels - 1, settings.channel);
+    std::vector<float*> channels(reader->numChannels, nullptr);
+
+    juce::int64 position = 0;
+    bool last = false;
+    while (!last)
+    {
+        AudioBlock* block = freeBlocks.pop();
+        if (block == nullptr) return;
+        const auto t = juce::Time::getHighResolutionTicks();
+
+        block->numSamples = (int) juce::jmin((juce::int64) settings.decodeBlockSamples, length - position);
+        channels[(size_t) channel] = block->samples.data();
+        if (block->numSamples > 0)
+            reader->read(channels.data(), (int) channels.size(), position, block->numSamples);
+        position += block->numSamples;
+        last = block->last = position >= length;
+        nSamplesDecoded = position;
+
+        addBusyTime(DecodeStage, t);
+        decodedBlocks.push(block);
+    }
+}
+
+void AnalysisPipeline::decimate()
+{
+    // The most recent windowSamples decimated samples, so frames may overlap (hop < window):
+    const int windowSamples = settings.windowSamples;
+    std::vector<float> history((size_t) windowSamples, 0.0f);
+    juce::int64 nDecimated = 0;
+    juce::int64 nextFrameEnd = windowSamples;
+    juce::int64 rawIndex = 0;
+    int frameIndex = 0;
+
+    auto emitFrame = [&] (bool last) {
+        Frame* frame = freeFrames.pop();
+        if (frame == nullptr) return false;
+        const juce::int64 frameStart = nextFrameEnd - windowSamples;
+        for (int i=0; i < windowSamples; i++)
+        {
+            const juce::int64 j = frameStart + i;
+            frame->signal[(size_t) i] = j < nDecimated ? history[(size_t) (j % windowSamples)] : 0.0f; // zero-padded at the end
+        }
+        frame->index = frameIndex++;
+        frame->time = (float) (frameStart * settings.downSamplingRate / sampleRate);
+        frame->last = last;
+        decimatedFrames.push(frame);
+        nextFrameEnd += settings.hopSamples;
+        return true;
+    };
+
+    bool last = false;
+    while (!last)
+    {
+        AudioBlock* block = decodedBlocks.pop();
+        if (block == nullptr) return;
+        auto t = juce::Time::getHighResolutionTicks();
+
+        // Keep every downSamplingRate-th sample, continuing the phase across blocks:
+        int i = (int) ((settings.downSamplingRate - rawIndex % settings.downSamplingRate) % settings.downSamplingRate);
+        for (; i < block->numSamples; i += settings.downSamplingRate)
+        {
+            history[(size_t) (nDecimated++ % windowSamples)] = block->samples[(size_t) i];
+            if (nDecimated == nextFrameEnd)
+            {
+                addBusyTime(DecimateStage, t); // not counting the wait for a free frame
+                if (!emitFrame(false)) return;
+                t = juce::Time::getHighResolutionTicks();
+            }
+        }
+        rawIndex += block->numSamples;
+        last = block->last;
+        freeBlocks.push(block);
+        addBusyTime(DecimateStage, t);
+    }
+
+    // A partial last window, or an end marker if the file ended exactly on a frame:
+    if (nDecimated > nextFrameEnd - windowSamples || frameIndex == 0)
+        emitFrame(true);
+    else if (Frame* frame = freeFrames.pop())
+    {
+        frame->index = -1; // End of stream only, not passed to the sink
+        frame->last = true;
+        decimatedFrames.push(frame);
+    }
+}
+
+void AnalysisPipeline::window()
+{
+    for (Frame* frame = decimatedFrames.pop(); frame != nullptr; frame = decimatedFrames.pop())
+    {
+        const auto t = juce::Time::getHighResolutionTicks();
+        if (frame->index >= 0) FFTSpectrum::hanningWindow(frame->signal.data(), settings.windowSamples);
+        addBusyTime(WindowStage, t);
+
+        const bool last = frame->last;
+        windowedFrames.push(frame);
+        if (last) return;
+    }
+}
+
+void AnalysisPipeline::fft()
+{
+    for (Frame* frame = windowedFrames.pop(); frame != nullptr; frame = windowedFrames.pop())
+    {
+        const auto t = juce::Time::getHighResolutionTicks();
+        if (frame->index >= 0)
+        {
+            ADDRSOUND_TRACE_SCOPE("AnalysisPipeline::fft");
+            FFTSpectrum::FFT(frame->signal.data(), frame->spectrum.data(), settings.nFreqs*2, settings.windowSamples);
+
+            float maxMagnitude = 0.0f; // Normalised per frame, as FFTSpectrum
+            for (int i=0; i < settings.nFreqs; i++)
+            {
+                const float magnitude = std::abs(frame->spectrum[(size_t) i]);
+                frame->magnitudes[(size_t) i] = magnitude;
+                maxMagnitude = juce::jmax(maxMagnitude, magnitude);
+            }
+            if (settings.normalise && maxMagnitude > 0.0f)
+                juce::FloatVectorOperations::multiply(frame->magnitudes.data(), 1.0f / maxMagnitude, settings.nFreqs);
+        }
+        addBusyTime(FFTStage, t);
+
+        const bool last = frame->last;
+        transformedFrames.push(frame);
+        if (last) return;
+    }
+}
+
+void AnalysisPipeline::pickPeaks()
+{
+    for (Frame* frame = transformedFrames.pop(); frame != nullptr; frame = transformedFrames.pop())
+    {
+        const auto t = juce::Time::getHighResolutionTicks();
+        frame->peaks.indexs.clear();
+        frame->peaks.values.clear();
+        if (frame->index >= 0)
+        {
+            PeakFinder::findPeaks(frame->magnitudes, frame->peaks.indexs, false);
+            for (int index : frame->peaks.indexs) frame->peaks.values.push_back(frame->magnitudes[(size_t) index]);
+        }
+        addBusyTime(PeakStage, t);
+
+        const bool last = frame->last;
+        peakFrames.push(frame);
+        if (last) return;
+    }
+}
+
+void AnalysisPipeline::sink()
+{
+    for (Frame* frame = peakFrames.pop(); frame != nullptr; frame = peakFrames.pop())
+    {
+        const auto t = juce::Time::getHighResolutionTicks();
+        if (frame->index >= 0)
+        {
+            if (frameSink) frameSink(*frame);
+            nFramesDone++;
+        }
+        addBusyTime(SinkStage, t);
+
+        const bool last = frame->last;
+        freeFrames.push(frame);
+        if (last)
+        {
+            endTicks = juce::Time::getHighResolutionTicks();
+            finished.signal();
+            return;
+        }
+    }
+}
+
+void AnalysisPipeline::addBusyTime(int stage, juce::int64 fromTicks)
+{
+    busyTicks[(size_t) stage] += juce::Time::getHighResolutionTicks() - fromTicks;
+}
+
+//==============================================================================
+float AnalysisPipeline::getProgress() const
+{
+    if (reader == nullptr || reader->lengthInSamples <= 0) return 0.0f;
+    return (float) nSamplesDecoded.load() / (float) reader->lengthInSamples;
+}
+
+static double secondsSince(juce::int64 startTicks, juce::int64 endTicks)
+{
+    if (endTicks == 0) endTicks = juce::Time::getHighResolutionTicks();
+    return juce::Time::highResolutionTicksToSeconds(endTicks - startTicks);
+}
+
+double AnalysisPipeline::getFramesPerSecond() const
+{
+    const double elapsed = secondsSince(startTicks, endTicks);
+    return elapsed > 0.0 ? nFramesDone.load() / elapsed : 0.0;
+}
+
+double AnalysisPipeline::getRealtimeFactor() const
+{
+    const double elapsed = secondsSince(startTicks, endTicks);
+    const double analysedSeconds = (double) nFramesDone.load() * settings.hopSamples * settings.downSamplingRate / sampleRate;
+    return elapsed > 0.0 ? analysedSeconds / elapsed : 0.0;
+}
+
+double AnalysisPipeline::getStageBusySeconds(int stage) const
+{
+    return juce::Time::highResolutionTicksToSeconds(busyTicks[(size_t) stage].load());
+}
+
+juce::String AnalysisPipeline::getReport() const
+{
+    const double elapsed = secondsSince(startTicks, endTicks);
+    juce::String report;
+    report << nFramesDone.load() << " frames in " << juce::String(elapsed, 2) << " s ("
+           << juce::String(getFramesPerSecond(), 1) << " frames/s, "
+           << juce::String(getRealtimeFactor(), 1) << "x real time)";
+    for (int stage = 0; stage < nStages; stage++)
+    {
+        report << "\n  " << getStageName(stage) << ": " << juce::String(getStageBusySeconds(stage), 3) << " s busy";
+        if (elapsed > 0.0) report << " (" << juce::String(100.0 * getStageBusySeconds(stage) / elapsed, 1) << "%)";
+    }
+    return report;
+}
@@ -0,0 +1,162 @@
+#pragma once
+
+#include <array>
+#include <complex>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+
+#include <juce_audio_formats/juce_audio_formats.h>
+
+#include "Spectrum.h"
+
+// Streaming analysis of arbitrarily long recordings. The file is pulled through
+// decode -> decimate -> window -> FFT -> peak pick -> sink, each stage on its own thread.
+// Blocks and frames come from fixed pools that circulate through bounded queues, so memory use
+// depends only on the settings, never on the duration of the file.
+// The analysis matches FFTSpectrum: every downSamplingRate-th sample of one channel, a Hanning
+// window, and (by default) magnitudes normalised per frame.
+class AnalysisPipeline
+{
+public:
+    struct Settings
+    {
+        int nFreqs = 512;
+        int windowSamples = 512; // decimated samples per frame
+        int downSamplingRate = 2;
+        int hopSamples = 512; // decimated samples between frame starts
+        int channel = 0;
+        int decodeBlockSamples = 16384;
+        int queueDepth = 4; // blocks/frames in flight between two stages
+        bool normalise = true; // per frame, as FFTSpectrum; otherwise raw FFT magnitudes
+    };
+
+    struct Frame
+    {
+        int index = 0;
+        float time = 0.0f; // start of the window, in seconds
+        std::vector<float> signal; // windowSamples
+        std::vector<std::complex<float>> spectrum; // nFreqs*2
+        std::vector<float> magnitudes; // nFreqs, normalised
+        Spectrum::Peaks peaks;
+        bool last = false;
+    };
+    // Called on the sink thread for every frame in order. The frame is recycled afterwards.
+    using Sink = std::function<void (const Frame&)>;
+
+    AnalysisPipeline(const Settings& settings);
+    ~AnalysisPipeline();
+
+    // Takes ownership of the reader. Only one run at a time.
+    void start(juce::AudioFormatReader* reader, Sink sink);
+    void cancel();
+    void stop(); // Joins every stage thread (cancelling unless finished), so the sink isn't called again
+    bool waitForCompletion(int timeoutMs = -1); // true once every frame reached the sink
+    bool wasCancelled() const {return cancelled.load();}
+
+    float getFrequency(int index) const; // of a magnitude bin
+    double getSampleRate() const {return sampleRate;}
+
+    // Monitoring (any thread):
+    float getProgress() const; // fraction of the file decoded
+    int getNumFramesAnalysed() const {return nFramesDone.load();}
+    double getFramesPerSecond() const;
+    double getRealtimeFactor() const; // seconds of audio analysed per second
+    double getStageBusySeconds(int stage) const;
+    juce::String getReport() const; // throughput and time spent busy in each stage
+
+    enum Stages {DecodeStage, DecimateStage, WindowStage, FFTStage, PeakStage, SinkStage, nStages};
+    static const char* getStageName(int stage);
+
+private:
+    // Blocking FIFO of pool items. Its capacity covers the whole pool, so push never blocks.
+    template <typename T>
+    class BoundedQueue
+    {
+    public:
+        void reset(int capacity)
+        {
+            items.assign((size_t) capacity, nullptr);
+            head = 0; size = 0; closed = false;
+        }
+        void push(T* item)
+        {
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                jassert(size < (int) items.size());
+                items[(size_t) ((head + size++) % (int) items.size())] = item;
+            }
+            ready.notify_one();
+        }
+        T* pop() // nullptr once closed
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            ready.wait(lock, [this] {return size > 0 || closed;});
+            if (closed) return nullptr;
+            T* item = items[(size_t) head];
+            head = (head + 1) % (int) items.size();
+            size--;
+            return item;
+        }
+        void close()
+        {
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                closed = true;
+            }
+            ready.notify_all();
+        }
+    private:
+        std::vector<T*> items;
+        int head = 0, size = 0;
+        bool closed = false;
+        std::mutex mutex;
+        std::condition_variable ready;
+    };
+
+    struct AudioBlock
+    {
+        std::vector<float> samples; // decodeBlockSamples of the analysed channel
+        int numSamples = 0;
+        bool last = false;
+    };
+
+    class StageThread : public juce::Thread
+    {
+    public:
+        StageThread(const juce::String& name, std::function<void()> body) : juce::Thread(name), body(std::move(body)) {}
+        void run() override {body();}
+    private:
+        std::function<void()> body;
+    };
+
+    void decode();
+    void decimate();
+    void window();
+    void fft();
+    void pickPeaks();
+    void sink();
+
+    void addBusyTime(int stage, juce::int64 startTicks);
+    void stopThreads();
+
+    const Settings settings;
+    std::unique_ptr<juce::AudioFormatReader> reader;
+    Sink frameSink;
+    double sampleRate;
+
+    std::vector<AudioBlock> blockPool;
+    std::vector<Frame> framePool;
+    BoundedQueue<AudioBlock> freeBlocks, decodedBlocks;
+    BoundedQueue<Frame> freeFrames, decimatedFrames, windowedFrames, transformedFrames, peakFrames;
+
+    std::vector<std::unique_ptr<StageThread>> threads;
+    std::atomic<bool> cancelled;
+    juce::WaitableEvent finished;
+
+    std::atomic<juce::int64> nSamplesDecoded;
+    std::atomic<int> nFramesDone;
+    juce::int64 startTicks;
+    std::atomic<juce::int64> endTicks;
+    std::array<std::atomic<juce::int64>, nStages> busyTicks;
+};
@@ -0,0 +1,156 @@
+#include <juce_audio_formats/juce_audio_formats.h>
+
+#include "BatchConverter.h"
+#include "AdditiveSpectrum.h"
+#include "FFTSpectrum.h"
+#include "PitchDetector.h"
+#include "Tracer.h"
+
+BatchConverter::BatchConverter(const Settings& s)
+    : settings(s) {}
+
+juce::Array<juce::File> BatchConverter::findAudioFiles(const juce::File& folder, bool recursive)
+{
+    juce::AudioFormatManager formatManager;
+    formatManager.registerBasicFormats();
+    auto files = folder.findChildFiles(juce::File::findFiles, recursive, formatManager.getWildcardForAllFormats());
+    files.sort(); // Reports and outputs in a stable order
+    return files;
+}
+
+float BatchConverter::noteFrequencyFromFileName(const juce::String& fileName)
+{
+    const auto tokens = juce::StringArray::fromTokens(juce::File(fileName).getFileNameWithoutExtension(), " _-.()[]", "");
+    for (int i = tokens.size() - 1; i >= 0; i--) // Names usually end with the note
+    {
+        const auto token = tokens[i];
+        const int letter = juce::String("CDEFGAB").indexOfChar(juce::CharacterFunctions::toUpperCase(token[0]));
+        if (token.length() < 2 || token.length() > 3 || letter < 0) continue;
+
+        static const int semitones[] = {0, 2, 4, 5, 7, 9, 11};
+        int semitone = semitones[letter];
+        int octaveIndex = 1;
+        if (token[1] == '#') {semitone++; octaveIndex++;}
+        else if (token[1] == 'b' && token.length() == 3) {semitone--; octaveIndex++;}
+        if (octaveIndex != token.length() - 1 || !juce::CharacterFunctions::isDigit(token[octaveIndex])) continue;
+
+        const int midiNote = 12 * (token[octaveIndex] - '0' + 1) + semitone;
+        return (float) juce::MidiMessage::getMidiNoteInHertz(midiNote);
+    }
+    return 0.0f;
+}
+
+void BatchConverter::run(const juce::Array<juce::File>& files, const juce::File& inputFolder,
+                         const std::function<void (int nDone, int nFiles)>& progress)
+{
+    results.assign((size_t) files.size(), {});
+    for (int i = 0; i < files.size(); i++) results[(size_t) i].input = files[i];
+    if (files.isEmpty()) return;
+
+    const auto startTicks = juce::Time::getHighResolutionTicks();
+    std::atomic<int> nDone(0);
+    {
+        juce::ThreadPool pool(juce::jlimit(1, files.size(), settings.nThreads > 0 ? settings.nThreads : juce::SystemStats::getNumCpus()));
+        for (auto& result : results)
+        {
+            pool.addJob([this, &result, &inputFolder, &nDone] {
+                convert(result, inputFolder);
+                nDone++;
+            });
+        }
+        while (nDone.load() < files.size())
+        {
+            if (progress) progress(nDone.load(), files.size());
+            juce::Thread::sleep(250);
+        }
+    }
+    if (progress) progress(files.size(), files.size());
+    wallSeconds = juce::Time::highResolutionTicksToSeconds(juce::Time::getHighResolutionTicks() - startTicks);
+}
+
+void BatchConverter::convert(Result& result, const juce::File& inputFolder) const
+{
+    ADDRSOUND_TRACE_SCOPE("BatchConverter::convert");
+    result.noteFreq = settings.noteFreq;
+    if (result.noteFreq <= 0.0f) result.noteFreq = noteFrequencyFromFileName(result.input.getFileName());
+    if (result.noteFreq <= 0.0f && settings.detectPitch)
+    {
+        const auto pitchTicks = juce::Time::getHighResolutionTicks();
+        FFTSpectrum spectrum(512, 512, 2); // The same signal as the tracker analyses
+        PitchDetector pitchDetector;
+        if (spectrum.addAudioSource(result.input)) result.noteFreq = pitchDetector.estimateNoteFrequency(spectrum);
+        result.noteDetected = result.noteFreq > 0.0f;
+        result.pitchSeconds = juce::Time::highResolutionTicksToSeconds(juce::Time::getHighResolutionTicks() - pitchTicks);
+    }
+    if (result.noteFreq <= 0.0f) result.noteFreq = settings.defaultNoteFreq;
+
+    PartialTracker::Settings trackerSettings = settings.tracker;
+    trackerSettings.nThreads = 1; // Files are the unit of parallelism
+    PartialTracker tracker(trackerSettings);
+    const bool analysed = tracker.analyse(result.input, result.noteFreq);
+    result.openSeconds = tracker.getOpenSeconds();
+    result.analysisSeconds = tracker.getAnalysisSeconds();
+    result.linkingSeconds = tracker.getLinkingSeconds();
+    if (!analysed)
+    {
+        result.error = "could not be read as audio";
+        return;
+    }
+    result.nTracks = (int) tracker.getTracks().size();
+    for (auto& track : tracker.getTracks()) if (track.harmonic >= 0) result.nHarmonicTracks++;
+    if (result.nHarmonicTracks == 0)
+    {
+        result.error = "no harmonic partials of " + juce::String(result.noteFreq, 1) + " Hz";
+        return;
+    }
+
+    const auto writeTicks = juce::Time::getHighResolutionTicks();
+    result.output = settings.outputFolder == juce::File()
+        ? result.input.withFileExtension("addrsound")
+        : settings.outputFolder.getChildFile(result.input.getRelativePathFrom(inputFolder)).withFileExtension("addrsound");
+    result.output.getParentDirectory().createDirectory();
+
+    AdditiveSpectrum spectrum(trackerSettings.nHarmonics, result.noteFreq, 0.5f, 10);
+    tracker.writeKeyFrames(spectrum);
+    juce::FileOutputStream fileStream(result.output);
+    if (fileStream.openedOk())
+    {
+        fileStream.setPosition(0);
+        fileStream.truncate();
+        spectrum.saveSpectrum(fileStream, settings.compressedBits);
+        fileStream.flush();
+    }
+    if (!fileStream.openedOk() || fileStream.getStatus().failed())
+        result.error = "could not write " + result.output.getFullPathName();
+    result.writeSeconds = juce::Time::highResolutionTicksToSeconds(juce::Time::getHighResolutionTicks() - writeTicks);
+}
+
+juce::String BatchConverter::getReport() const
+{
+    int nConverted = 0, nDetected = 0;
+    double pitch = 0.0, open = 0.0, analysis = 0.0, linking = 0.0, write = 0.0;
+    juce::String failures;
+    for (auto& result : results)
+    {
+        if (result.error.isEmpty()) nConverted++;
+        else failures << "  " << result.input.getFullPathName() << ": " << result.error << "\n";
+        if (result.noteDetected) nDetected++;
+        pitch += result.pitchSeconds;
+        open += result.openSeconds;
+        analysis += result.analysisSeconds;
+        linking += result.linkingSeconds;
+        write += result.writeSeconds;
+    }
+
+    // Stage times are summed over all jobs, so they add up to about nThreads times the wall time:
+    const auto ms = [] (double seconds) {return juce::String(seconds * 1000.0, 1) + " ms";};
+    const int nFiles = (int) results.size();
+    juce::String report;
+    report << nConverted << " of " << nFiles << " files converted in " << juce::String(wallSeconds, 2) << " s ("
+           << juce::String(wallSeconds > 0.0 ? nFiles / wallSeconds : 0.0, 1) << " files/s)\n"
+           << nDetected << " notes detected from the audio\n"
+           << "Stage totals: pitch " << ms(pitch) << ", open " << ms(open) << ", analyse " << ms(analysis)
+           << ", link " << ms(linking) << ", write " << ms(write) << "\n";
+    if (failures.isNotEmpty()) report << "Failed:\n" << failures;
+    return report;
+}
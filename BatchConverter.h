@@ -0,0 +1,60 @@
+#pragma once
+
+#include <juce_core/juce_core.h>
+
+#include "PartialTracker.h"
+
+// Converts audio files to .addrsound spectra in parallel, for building patch libraries from
+// folders of sampled notes (see BatchMain.cpp). Each file is one job on a thread pool and is
+// analysed by a single threaded PartialTracker: the tracker caps the frames kept per file and
+// FFTSpectrum maps or buffers the audio rather than loading it, so the memory of a job doesn't
+// grow with the length of its file, and at most nThreads jobs run at once.
+class BatchConverter
+{
+public:
+    struct Settings
+    {
+        int nThreads = 0; // 0: one per core
+        PartialTracker::Settings tracker;
+        // 0: from a note name in the file name (e.g. "Piano_C#4.wav"), else detected from the audio
+        // (if detectPitch), else defaultNoteFreq
+        float noteFreq = 0.0f;
+        bool detectPitch = true;
+        float defaultNoteFreq = 440.0f;
+        juce::File outputFolder; // mirrors the input folder; next to each input file if unset
+        int compressedBits = 0; // 8, 12 or 16 to save the keyframes with KeyFrameCodec
+    };
+
+    struct Result
+    {
+        juce::File input, output;
+        juce::String error; // empty on success
+        float noteFreq = 0.0f;
+        bool noteDetected = false;
+        int nTracks = 0, nHarmonicTracks = 0;
+        // Stages: detecting the pitch, opening the file, analysing every frame, linking partials, writing the spectrum
+        double pitchSeconds = 0.0, openSeconds = 0.0, analysisSeconds = 0.0, linkingSeconds = 0.0, writeSeconds = 0.0;
+    };
+
+    BatchConverter(const Settings& settings);
+
+    // Every file the basic audio formats can read
+    static juce::Array<juce::File> findAudioFiles(const juce::File& folder, bool recursive);
+
+    // Converts files (within inputFolder). Blocks, calling progress from the calling thread now and then.
+    void run(const juce::Array<juce::File>& files, const juce::File& inputFolder,
+             const std::function<void (int nDone, int nFiles)>& progress = nullptr);
+
+    const std::vector<Result>& getResults() const {return results;}
+    juce::String getReport() const;
+
+    // Frequency of a note name token such as "A4", "C#3" or "Eb5" in a file name, or 0
+    static float noteFrequencyFromFileName(const juce::String& fileName);
+
+private:
+    void convert(Result& result, const juce::File& inputFolder) const;
+
+    const Settings settings;
+    std::vector<Result> results;
+    double wallSeconds = 0.0;
+};
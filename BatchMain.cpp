@@ -0,0 +1,254 @@
+#include <juce_data_structures/juce_data_structures.h>
+
+#include "AdditiveSpectrum.h"
+#include "BatchConverter.h"
+#include "KeyFrameCodec.h"
+#include "RenderPool.h"
+#include "WaveTableOscillator.h"
+
+// AddrSoundBatch: converts folders of sampled notes into .addrsound spectra without the GUI.
+//   AddrSoundBatch <input folder> [output folder] [--recursive] [--threads=N] [--harmonics=N] [--note=Hz] [--no-pitch] [--compress=BITS]
+//   AddrSoundBatch --benchmark <folder> [--recursive] [--repeats=N]
+//   AddrSoundBatch --benchmark-render [--workers=N] [--block=N]
+
+static void convertFolder(const juce::ArgumentList& args)
+{
+    juce::StringArray folders;
+    for (int i = 0; i < args.size(); i++)
+        if (!args[i].isOption()) folders.add(args[i].text);
+    if (folders.isEmpty()) juce::ConsoleApplication::fail("Expected an input folder (see --help)");
+
+    const juce::File inputFolder = juce::File::getCurrentWorkingDirectory().getChildFile(folders[0]);
+    if (!inputFolder.isDirectory()) juce::ConsoleApplication::fail("Not a folder: " + inputFolder.getFullPathName());
+
+    BatchConverter::Settings settings;
+    if (folders.size() > 1) settings.outputFolder = juce::File::getCurrentWorkingDirectory().getChildFile(folders[1]);
+    if (args.containsOption("--threads")) settings.nThreads = args.getValueForOption("--threads").getIntValue();
+    if (args.containsOption("--harmonics")) settings.tracker.nHarmonics = juce::jmax(1, args.getValueForOption("--harmonics").getIntValue());
+    if (args.containsOption("--note")) settings.noteFreq = args.getValueForOption("--note").getFloatValue();
+    settings.detectPitch = !args.containsOption("--no-pitch");
+    if (args.containsOption("--compress"))
+    {
+        settings.compressedBits = args.getValueForOption("--compress").getIntValue();
+        if (!KeyFrameCodec::isValidBits(settings.compressedBits)) juce::ConsoleApplication::fail("--compress takes 8, 12 or 16 bits");
+    }
+
+    const auto files = BatchConverter::findAudioFiles(inputFolder, args.containsOption("--recursive"));
+    std::cout << files.size() << " audio files in " << inputFolder.getFullPathName() << std::endl;
+
+    BatchConverter converter(settings);
+    converter.run(files, inputFolder, [] (int nDone, int nFiles) {
+        std::cout << "\r" << nDone << " / " << nFiles << std::flush;
+    });
+    std::cout << "\n" << converter.getReport() << std::flush;
+
+    for (auto& result : converter.getResults())
+        if (result.error.isNotEmpty()) juce::ConsoleApplication::fail("Some files could not be converted", 2);
+}
+
+// Saves every .addrsound patch in a folder with each keyframe encoding and times reading them back
+static void benchmarkCompression(const juce::ArgumentList& args)
+{
+    juce::StringArray folders;
+    for (int i = 0; i < args.size(); i++)
+        if (!args[i].isOption()) folders.add(args[i].text);
+    if (folders.isEmpty()) juce::ConsoleApplication::fail("Expected a folder of .addrsound files (see --help)");
+
+    const juce::File folder = juce::File::getCurrentWorkingDirectory().getChildFile(folders[0]);
+    const auto files = folder.findChildFiles(juce::File::findFiles, args.containsOption("--recursive"), "*.addrsound");
+    if (files.isEmpty()) juce::ConsoleApplication::fail("No .addrsound files in " + folder.getFullPathName());
+    const int repeats = args.containsOption("--repeats") ? juce::jmax(1, args.getValueForOption("--repeats").getIntValue()) : 10;
+
+    const int encodings[] = {0, 8, 12, 16}; // 0: plain properties
+    const int nEncodings = (int) (sizeof(encodings) / sizeof(encodings[0]));
+    std::vector<std::vector<juce::MemoryBlock>> saved((size_t) nEncodings);
+    juce::int64 magnitudeBytes = 0; // of the active keyframes as float32
+    AdditiveSpectrum spectrum(1, 440.0f, 1.0f, 2);
+    juce::Array<float> keyFrameTimes;
+    for (auto& file : files)
+    {
+        juce::FileInputStream fileStream(file);
+        if (!fileStream.openedOk()) continue;
+        spectrum.loadSpectrum(fileStream);
+        spectrum.updateKeyFrameTimes(keyFrameTimes);
+        magnitudeBytes += (juce::int64) keyFrameTimes.size() * spectrum.getNFreqs() * (juce::int64) sizeof(float);
+        for (int e = 0; e < nEncodings; e++)
+        {
+            juce::MemoryOutputStream stream;
+            spectrum.saveSpectrum(stream, encodings[e]);
+            saved[(size_t) e].push_back(stream.getMemoryBlock());
+        }
+    }
+    const double megabytes = (double) magnitudeBytes * repeats / 1.0e6;
+    std::cout << files.size() << " patches, " << juce::String((double) magnitudeBytes / 1.0e6, 2) << " MB of float32 magnitudes" << std::endl;
+
+    juce::int64 plainBytes = 0;
+    for (int e = 0; e < nEncodings; e++)
+    {
+        const auto& blocks = saved[(size_t) e];
+        juce::int64 bytes = 0;
+        for (auto& block : blocks) bytes += (juce::int64) block.getSize();
+        if (e == 0) plainBytes = bytes;
+
+        // Loading, as when scanning a library:
+        auto startTicks = juce::Time::getHighResolutionTicks();
+        for (int r = 0; r < repeats; r++)
+            for (auto& block : blocks)
+            {
+                juce::MemoryInputStream stream(block, false);
+                spectrum.loadSpectrum(stream);
+            }
+        const double loadSeconds = juce::Time::highResolutionTicksToSeconds(juce::Time::getHighResolutionTicks() - startTicks);
+
+        juce::String line = (encodings[e] == 0 ? juce::String("plain") : juce::String(encodings[e]) + " bit (+-"
+                             + juce::String(KeyFrameCodec::getStepDecibels(encodings[e]) / 2, 3) + " dB)")
+                          + ": " + juce::String((double) bytes / 1.0e6, 2) + " MB, "
+                          + juce::String((double) magnitudeBytes / (double) juce::jmax((juce::int64) 1, bytes), 1) + "x smaller than float32, "
+                          + juce::String((double) plainBytes / (double) juce::jmax((juce::int64) 1, bytes), 1) + "x than plain, loads at "
+                          + juce::String(megabytes / loadSeconds, 1) + " MB/s";
+
+        if (encodings[e] > 0)
+        {
+            // The codec alone:
+            struct Encoded {const juce::MemoryBlock* data; int nKeyFrames, nFreqs;};
+            std::vector<juce::ValueTree> trees;
+            std::vector<Encoded> encoded;
+            size_t maxValues = 0;
+            for (auto& block : blocks)
+            {
+                juce::MemoryInputStream stream(block, false);
+                trees.push_back(juce::ValueTree::readFromStream(stream));
+                const juce::ValueTree compressedTree = trees.back().getChildWithName("CompressedKeyframeData");
+                const auto* indexData = compressedTree["kFIndexes"].getBinaryData();
+                const auto* magnitudeData = compressedTree["magnitudes"].getBinaryData();
+                if (indexData == nullptr || magnitudeData == nullptr) continue;
+                encoded.push_back({magnitudeData, (int) indexData->getSize() / 4, (int) trees.back()["nFreqs"]});
+                maxValues = juce::jmax(maxValues, (size_t) encoded.back().nKeyFrames * (size_t) encoded.back().nFreqs);
+            }
+            std::vector<float> magnitudes(maxValues);
+            startTicks = juce::Time::getHighResolutionTicks();
+            for (int r = 0; r < repeats; r++)
+                for (auto& patch : encoded)
+                    KeyFrameCodec::decode(*patch.data, magnitudes.data(), patch.nKeyFrames, patch.nFreqs);
+            const double decodeSeconds = juce::Time::highResolutionTicksToSeconds(juce::Time::getHighResolutionTicks() - startTicks);
+            line << ", decodes at " << juce::String(megabytes / decodeSeconds, 1) << " MB/s";
+        }
+        std::cout << line << std::endl;
+    }
+}
+
+// Renders blocks of wavetable partials split across 1..N RenderPool workers, as the app's audio
+// callback does, to find the number of partials from which splitting pays for waking the workers
+static void benchmarkRendering(const juce::ArgumentList& args)
+{
+    const int maxWorkers = args.containsOption("--workers") ? juce::jmax(1, args.getValueForOption("--workers").getIntValue())
+                                                            : juce::jlimit(1, 4, juce::SystemStats::getNumCpus());
+    const int blockSize = args.containsOption("--block") ? juce::jmax(16, args.getValueForOption("--block").getIntValue()) : 512;
+    const float sampleRate = 48000.0f;
+    const double secondsPerRun = 0.25;
+
+    juce::AudioSampleBuffer sineTable(1, 2048 + 1);
+    for (int i = 0; i <= 2048; i++)
+        sineTable.setSample(0, i, (float) std::sin(juce::MathConstants<double>::twoPi * i / 2048));
+    std::atomic<double> noVibrato {0.0};
+
+    struct Job : RenderPool::Job
+    {
+        juce::OwnedArray<WavetableOscillator> oscillators;
+        juce::AudioSampleBuffer mixes;
+        int numSamples = 0;
+
+        void render(int worker, int nWorkers) noexcept override
+        {
+            auto* mix = mixes.getWritePointer(worker);
+            juce::FloatVectorOperations::clear(mix, numSamples);
+            const int nOscillators = oscillators.size();
+            for (int o = nOscillators * worker / nWorkers; o < nOscillators * (worker + 1) / nWorkers; o++)
+            {
+                auto* oscillator = oscillators.getUnchecked(o);
+                for (int sample = 0; sample < numSamples; sample++) mix[sample] += oscillator->getNextSample();
+            }
+        }
+    };
+
+    std::cout << "Block of " << blockSize << " samples, microseconds per block (speedup over 1 worker)" << std::endl;
+    int threshold = 0;
+    for (int nPartials : {16, 32, 64, 128, 256, 512, 1024})
+    {
+        Job job;
+        job.numSamples = blockSize;
+        job.mixes.setSize(maxWorkers, blockSize);
+        for (int i = 0; i < nPartials; i++)
+        {
+            auto* oscillator = new WavetableOscillator(sineTable, sampleRate);
+            oscillator->setFrequency(55.0f * (float) (1 + i % 400));
+            oscillator->setAmplitude(1.0f / (float) (i + 1));
+            oscillator->setVibratoFactor(&noVibrato);
+            job.oscillators.add(oscillator);
+        }
+
+        juce::String line = juce::String(nPartials).paddedLeft(' ', 5) + " partials:";
+        double serialMicroseconds = 0.0;
+        bool faster = false;
+        for (int nWorkers = 1; nWorkers <= maxWorkers; nWorkers++)
+        {
+            RenderPool pool;
+            pool.start(nWorkers, blockSize / sampleRate);
+            for (int warmUp = 0; warmUp < 50; warmUp++) pool.run(job);
+
+            int nBlocks = 0;
+            const auto startTicks = juce::Time::getHighResolutionTicks();
+            double seconds = 0.0;
+            while (seconds < secondsPerRun)
+            {
+                pool.run(job);
+                // As the app does, the worker mixes are summed into the output:
+                for (int worker = 1; worker < nWorkers; worker++)
+                    job.mixes.addFrom(0, 0, job.mixes, worker, 0, blockSize);
+                nBlocks++;
+                seconds = juce::Time::highResolutionTicksToSeconds(juce::Time::getHighResolutionTicks() - startTicks);
+            }
+            const double microseconds = seconds * 1.0e6 / nBlocks;
+            if (nWorkers == 1) serialMicroseconds = microseconds;
+            else faster = faster || microseconds < 0.9 * serialMicroseconds; // Clearly, not by noise
+            line << "  " << nWorkers << ": " << juce::String(microseconds, 1)
+                 << " (" << juce::String(serialMicroseconds / microseconds, 2) << "x)";
+        }
+        std::cout << line << std::endl;
+        if (faster && threshold == 0) threshold = nPartials;
+    }
+    std::cout << (threshold > 0 ? "Parallel rendering pays off from about " + juce::String(threshold) + " partials"
+                                : juce::String("Parallel rendering didn't pay off at any partial count")) << std::endl;
+}
+
+int main(int argc, char* argv[])
+{
+    juce::ConsoleApplication app;
+    app.addHelpCommand("--help|-h", "AddrSoundBatch: converts folders of audio files (e.g. sampled notes) into .addrsound spectra.", false);
+    app.addDefaultCommand({"--convert",
+                           "[--convert] <input folder> [output folder] [--recursive] [--threads=N] [--harmonics=N] [--note=Hz] [--no-pitch] [--compress=BITS]",
+                           "Converts every audio file in a folder",
+                           "Each file is analysed into partial tracks which are mapped onto the harmonics of its note and saved as a "
+                           ".addrsound spectrum, mirroring the input folder in the output folder (next to each file by default). "
+                           "The note is taken from --note, else from a note name in the file name (e.g. Piano_C#4.wav), else it is "
+                           "detected from the audio (unless --no-pitch), else A4. "
+                           "Files are converted in parallel on --threads threads (one per core by default). "
+                           "--compress=8|12|16 quantises the keyframes to that many bits in dB and deflates them.",
+                           convertFolder});
+    app.addCommand({"--benchmark",
+                    "--benchmark <folder> [--recursive] [--repeats=N]",
+                    "Compares the keyframe encodings over a folder of .addrsound files",
+                    "Saves every patch as plain properties and compressed to 8, 12 and 16 bits, then reports the size of "
+                    "each encoding, how fast the patches load and how fast the compressed keyframes decode "
+                    "(in MB/s of float32 magnitudes).",
+                    benchmarkCompression});
+    app.addCommand({"--benchmark-render",
+                    "--benchmark-render [--workers=N] [--block=N]",
+                    "Measures how partial rendering scales over 1..N worker threads",
+                    "Renders blocks of sine partials (16 to 1024 of them) split across 1 to --workers threads of the app's "
+                    "RenderPool (up to 4 by default) and reports the time per block of --block samples (512 by default), "
+                    "and the partial count from which more than one worker is faster. The app's parallelRenderThreshold "
+                    "comes from this.",
+                    benchmarkRendering});
+    return app.findAndRunCommand(argc, argv);
+}
@@ -0,0 +1,55 @@
+#include "DistortionStage.h"
+#include "Tracer.h"
+
+juce::String DistortionStage::getOptionName(int option)
+{
+    return juce::String(2 << (option % 3)) + "x " + (option < 3 ? "IIR" : "FIR");
+}
+
+void DistortionStage::prepare(int newMaxBlockSize, float newFullScale)
+{
+    maxBlockSize = juce::jmax(1, newMaxBlockSize);
+    fullScale = newFullScale;
+    oversamplers.clear();
+    for (int option = 0; option < numOptions; option++)
+    {
+        const auto filter = option < 3 ? juce::dsp::Oversampling<float>::filterHalfBandPolyphaseIIR
+                                       : juce::dsp::Oversampling<float>::filterHalfBandFIREquiripple;
+        auto* oversampler = oversamplers.add(new juce::dsp::Oversampling<float>(1, (size_t) (option % 3 + 1), filter));
+        oversampler->initProcessing((size_t) maxBlockSize);
+    }
+    activeOption = -1;
+}
+
+void DistortionStage::process(float* samples, int numSamples, float amount) noexcept
+{
+    if (amount <= 0.0f || oversamplers.isEmpty())
+    {
+        activeOption = -1;
+        return;
+    }
+    ADDRSOUND_TRACE_SCOPE("DistortionStage::process");
+
+    const int option = selectedOption.load(std::memory_order_relaxed);
+    auto& oversampler = *oversamplers.getUnchecked(option);
+    if (option != activeOption)
+    {
+        oversampler.reset();
+        activeOption = option;
+    }
+
+    // Blends in tanh saturation, as steep at full amount as the square table it replaces, scaled
+    // so fullScale stays fullScale:
+    const float drive = 1.0f + 49.0f * amount;
+    const float gain = fullScale / std::tanh(drive);
+    for (int done = 0; done < numSamples; done += maxBlockSize)
+    {
+        float* channel = samples + done;
+        juce::dsp::AudioBlock<float> block(&channel, 1, (size_t) juce::jmin(maxBlockSize, numSamples - done));
+        auto upsampled = oversampler.processSamplesUp(block);
+        float* x = upsampled.getChannelPointer(0);
+        for (size_t i = 0; i < upsampled.getNumSamples(); i++)
+            x[i] = (1.0f - amount) * x[i] + amount * gain * std::tanh(drive * x[i] / fullScale);
+        oversampler.processSamplesDown(block);
+    }
+}
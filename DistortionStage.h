@@ -0,0 +1,30 @@
+#pragma once
+
+#include <juce_dsp/juce_dsp.h>
+
+// Waveshaping distortion of the summed partial bus. Shaping creates harmonics far above those of
+// the partials, which would fold back below Nyquist, so the shaper runs oversampled
+// (juce::dsp::Oversampling): one oversampled stage for the whole bus instead of one per oscillator.
+// Every oversampling option is built in prepare(), so switching between them never allocates.
+class DistortionStage
+{
+public:
+    static constexpr int numOptions = 6; // 2x, 4x, 8x with polyphase IIR, then with linear phase FIR filters
+    static constexpr int defaultOption = 1; // 4x IIR
+    static juce::String getOptionName(int option);
+
+    // Before the audio thread runs. fullScale is the bus level the shaper saturates towards.
+    void prepare(int maxBlockSize, float fullScale);
+    void setOption(int option) {selectedOption = juce::jlimit(0, numOptions - 1, option);} // any thread
+    int getOption() const {return selectedOption.load();}
+
+    // Audio thread: distorts the mono bus in place by amount (0..1); 0 bypasses the stage
+    void process(float* samples, int numSamples, float amount) noexcept;
+
+private:
+    juce::OwnedArray<juce::dsp::Oversampling<float>> oversamplers;
+    std::atomic<int> selectedOption {defaultOption};
+    int activeOption = -1; // audio thread: -1 whilst bypassed, so the filters restart clean
+    int maxBlockSize = 0;
+    float fullScale = 1.0f;
+};
@@ -10,12 +10,22 @@ public:
         vibratoControls(*this, 0.0, 0.2, "Vibrato", juce::Range<double>(0.0,1.0),false),
         distortionControls(*this, 0.0, 1.0, "Distortion", juce::Range<double>(0.0,1.0),false),
         reverbControls(*this, 0.0, 1.0,  "Reverb", juce::Range<double>(0.0,1.0),false),
+        pitchShiftControls(*this, 0.0, 1.0, "Pitch Shift", juce::Range<double>(-12.0,12.0),false),
+        harmonicSnapControls(*this, 0.0, 1.0, "Snap", juce::Range<double>(0.0,1.0),false),
+        partialLimitControls(*this, 128.0, 1.0, "Partials", juce::Range<double>(1.0,128.0),false),
+        morphControls(*this, 0.0, 1.0, "Morph", juce::Range<double>(0.0,1.0),false),
+        pickRadiusControls(*this, 2.5, 1.0, "Pick Radius", juce::Range<double>(1.0,20.0),false),
+        minPartialsControls(*this, 8.0, 1.0, "Min Partials", juce::Range<double>(1.0,128.0),false),
+        maxLoadControls(*this, 0.7, 1.0, "Max Load", juce::Range<double>(0.4,1.0),false),
         midiControls(*this, (double)PlaybackControlState::Play, 1.0, "MIDI"),
 
-        controlArray({&gainControls, &vibratoControls, &distortionControls, &reverbControls, &midiControls})
+        controlArray({&gainControls, &vibratoControls, &distortionControls, &reverbControls, &midiControls,
+                      &pitchShiftControls, &harmonicSnapControls, &partialLimitControls, &morphControls,
+                      &pickRadiusControls, &minPartialsControls, &maxLoadControls})
     {}
 
-    enum ControlID {Gain=0, Vibrato, Distortion, Reverb, Midi};
+    enum ControlID {Gain=0, Vibrato, Distortion, Reverb, Midi, PitchShift, HarmonicSnap, PartialLimit, Morph, PickRadius,
+                    MinPartials, MaxLoad}; // PitchShift to PartialLimit transform live resynthesis; MinPartials and MaxLoad limit the quality governor
     enum PlaybackControlState {Play = 0, Pause = 1, Stop = 2};
 
     std::atomic<double>* getControlValue(ControlID id)
@@ -108,7 +118,9 @@ private:
         juce::Label label;
         bool joyStick;
 
-    } gainControls, vibratoControls, distortionControls, reverbControls;
+    } gainControls, vibratoControls, distortionControls, reverbControls,
+      pitchShiftControls, harmonicSnapControls, partialLimitControls, morphControls, pickRadiusControls,
+      minPartialsControls, maxLoadControls;
 
     struct PlaybackControl : Control
     {
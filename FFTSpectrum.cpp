@@ -1,88 +1,369 @@
 #include "FFTSpectrum.h"
+#include "Tracer.h"
 
 FFTSpectrum::FFTSpectrum(int nFq, int windowSamples, int downSamplingRate)
-    : Spectrum(nFq,  0.0f), fftWindowSampleN(windowSamples), downSamplingRate(downSamplingRate),
-      audioSource(nullptr), useGlobalNormalisation(false)
+    : Spectrum(nFq,  0.0f), fftWindowSampleN(windowSamples), linearWindowSampleN(windowSamples), nLinearBins(nFq),
+      downSamplingRate(downSamplingRate),
+      fs(44100.0f), nTotalSamples(0), readPosition(0), analysedChannel(0),
+      readAheadThread("Reference read-ahead"), useGlobalNormalisation(false)
 {
     fftSpectrumArray.resize(nFreqs*2); // to account for other half of the symmetric FFT
     fftSpectrumArrayAbs.resize(nFreqs);
     
     inputBufferSize = fftWindowSampleN * downSamplingRate; // Take extra audio file samples for later downsampling
-    
-    inputBufferInfo.numSamples = inputBufferSize;
-    inputBufferInfo.startSample = 0;
-    inputBufferInfo.buffer = new juce::AudioSampleBuffer(2, inputBufferSize);
+    readBuffer.resize((size_t) inputBufferSize);
+    downSampled.resize((size_t) fftWindowSampleN);
 
     maxFFTMagnitude = 0.0f;
 }
 
 FFTSpectrum::~FFTSpectrum()
 {
-    delete inputBufferInfo.buffer;
     removeAudioSource();
 }
 
 float FFTSpectrum::getFrequency(int index) 
 {
-    auto nFFTPoints = nFreqs*2;
+    if (analysisMode == AnalysisMode::ConstantQ)
+        return constantQ.minFrequency * std::exp2((float) index / (float) constantQ.binsPerOctave);
+    if (analysisMode == AnalysisMode::Zoom)
+        return zoomStartFrequency + (float) index * zoomBinWidth;
+    auto nFFTPoints = nLinearBins*2;
     return index * (fs/downSamplingRate) / nFFTPoints;
 }
 float FFTSpectrum::getMagnitude(int fIndex) 
 {
     return fftSpectrumArrayAbs[fIndex];
 }
+float FFTSpectrum::getPhase(int fIndex)
+{
+    if (analysisMode == AnalysisMode::ConstantQ) return std::arg(constantQValues[(size_t) fIndex]);
+    if (analysisMode == AnalysisMode::Zoom) return std::arg(zoomValues[(size_t) fIndex]);
+    return std::arg(fftSpectrumArray[fIndex]);
+}
 
 float FFTSpectrum::getWindowPeriodSeconds() {return (float) inputBufferSize / fs;}
 
-juce::AudioSourceChannelInfo* FFTSpectrum::getInputBufferContainer() {return &inputBufferInfo;}
-
-void FFTSpectrum::addAudioSource(juce::AudioFormatReader* reader, bool ownsReader)
+bool FFTSpectrum::addAudioSource(const juce::File& file, int channel)
 {
-    audioSource.reset(new juce::AudioFormatReaderSource(reader, ownsReader));
-    fs = (float) audioSource->getAudioFormatReader()->sampleRate;
-    nTotalSamples = audioSource->getAudioFormatReader()->lengthInSamples;
+    removeAudioSource();
+
+    // Uncompressed files are mapped, so scrubbing anywhere in them needs no reads or copies:
+    juce::AudioFormat* mappableFormat = nullptr;
+    juce::WavAudioFormat wavFormat;
+    juce::AiffAudioFormat aiffFormat;
+    if (wavFormat.canHandleFile(file)) mappableFormat = &wavFormat;
+    else if (aiffFormat.canHandleFile(file)) mappableFormat = &aiffFormat;
+
+    juce::AudioFormatReader* reader = nullptr;
+    if (mappableFormat != nullptr)
+    {
+        mappedReader.reset(mappableFormat->createMemoryMappedReader(file));
+        if (mappedReader != nullptr && mappedReader->mapEntireFile())
+            reader = mappedReader.get();
+        else
+            mappedReader = nullptr;
+    }
+
+    if (reader == nullptr)
+    {
+        juce::AudioFormatManager formatManager;
+        formatManager.registerBasicFormats();
+        auto* decoder = formatManager.createReaderFor(file);
+        if (decoder == nullptr) return false;
+
+        // Decoded ahead in the background. The reader buffers whole blocks of 32768 samples, and
+        // needs at least two so that a window straddling a block boundary can be read:
+        readAheadThread.startThread();
+        auto* bufferingReader = new juce::BufferingAudioReader(decoder, readAheadThread,
+                                                               juce::jmax(4 * inputBufferSize, (int) (2 * decoder->sampleRate)));
+        bufferingReader->setReadTimeout(500); // A scrub jump has to wait for the decoder
+        streamReader.reset(bufferingReader);
+        reader = streamReader.get();
+    }
+
+    fs = (float) reader->sampleRate;
+    nTotalSamples = reader->lengthInSamples;
     duration = (float) nTotalSamples / fs;
     maxFFTMagnitude = 0.0f; // reset normalisation factor for new source
+    readPosition = 0;
+
+    const int nChannels = (int) reader->numChannels;
+    analysedChannel = juce::jlimit(0, nChannels - 1, channel);
+    readChannels.assign((size_t) nChannels, nullptr);
+    readChannels[(size_t) analysedChannel] = readBuffer.data();
+    if (analysisMode != AnalysisMode::Linear) setAnalysisMode(analysisMode); // Kernels and filters depend on the sample rate
+    return true;
+}
+
+void FFTSpectrum::setAnalysisMode(AnalysisMode mode, const ConstantQSettings& settings)
+{
+    analysisMode = mode;
+    constantQ = settings;
+    if (analysisMode == AnalysisMode::ConstantQ)
+        prepareConstantQ();
+    else if (analysisMode == AnalysisMode::Zoom)
+        prepareZoom();
+    else
+        setFrameSize(linearWindowSampleN, nLinearBins, nLinearBins*2);
+}
+
+void FFTSpectrum::setZoomBand(juce::Range<float> band)
+{
+    zoomBand = band;
+    if (analysisMode == AnalysisMode::Zoom) prepareZoom();
+}
+
+void FFTSpectrum::prepareZoom()
+{
+    const double rate = fs / downSamplingRate;
+    const double low = juce::jlimit(0.0, 0.5 * rate - 1.0, (double) zoomBand.getStart());
+    const double high = zoomBand.getEnd() > low ? juce::jmin(0.5 * rate, (double) zoomBand.getEnd()) : 0.5 * rate;
+    const double centre = 0.5 * (low + high);
+    const int N = zoomFFTSize;
+
+    // Decimate to 1.5x the bandwidth, leaving room for the filter's transition band (a complex
+    // signal needs no more than its bandwidth), unless the window would get too long:
+    const int maxDecimation = juce::jmax(1, (int) (maxZoomWindowSeconds * rate) / (N + 8));
+    zoomDecimation = juce::jlimit(1, maxDecimation, (int) (rate / (1.5 * (high - low))));
+    const int nTaps = 8 * zoomDecimation + 1;
+    zoomBinWidth = (float) (rate / zoomDecimation / N);
+
+    // Keep the bins within the band (the FFT has N/2 either side of the centre):
+    zoomFirstBin = juce::jmax(-N/2, (int) std::ceil((low - centre) / zoomBinWidth));
+    const int lastBin = juce::jmin(N/2 - 1, (int) std::floor((high - centre) / zoomBinWidth));
+    zoomStartFrequency = (float) centre + (float) zoomFirstBin * zoomBinWidth;
+    setFrameSize((N - 1) * zoomDecimation + nTaps, lastBin - zoomFirstBin + 1, N);
+
+    // Hann windowed sinc low-pass, cut off a little past the band edge, mixed down by the centre:
+    const double pi = juce::MathConstants<double>::pi;
+    const double omega = 2.0 * pi * centre / rate;
+    const double cutoff = 0.55 / zoomDecimation; // cycles per sample
+    zoomTaps.resize((size_t) nTaps);
+    double sum = 0.0;
+    for (int t = 0; t < nTaps; t++)
+    {
+        const double x = t - 0.5 * (nTaps - 1);
+        const double sinc = x == 0.0 ? 1.0 : std::sin(2.0 * pi * cutoff * x) / (2.0 * pi * cutoff * x);
+        const double h = sinc * (0.5 - 0.5 * std::cos(2.0 * pi * (t + 1) / (nTaps + 1)));
+        zoomTaps[(size_t) t] = (std::complex<float>) std::polar(h, -omega * t);
+        sum += h;
+    }
+    for (auto& tap : zoomTaps) tap /= (float) sum; // Unity gain in the band
+
+    // The rest of the mixing, and the Hann window of the decimated frame:
+    zoomRotations.resize((size_t) N);
+    for (int m = 0; m < N; m++)
+        zoomRotations[(size_t) m] = (std::complex<float>) std::polar(0.5 - 0.5 * std::cos(2.0 * pi * m / N), -omega * m * zoomDecimation);
+
+    zoomReal.resize((size_t) N);
+    zoomImag.resize((size_t) N);
+    zoomImagSpectrum.resize((size_t) N);
+    zoomValues.resize((size_t) nFreqs);
+}
+
+void FFTSpectrum::setFrameSize(int windowSamples, int nOutputBins, int nFFTPoints)
+{
+    fftWindowSampleN = windowSamples;
+    inputBufferSize = fftWindowSampleN * downSamplingRate;
+    readBuffer.resize((size_t) inputBufferSize);
+    if (!readChannels.empty()) readChannels[(size_t) analysedChannel] = readBuffer.data();
+    downSampled.resize((size_t) fftWindowSampleN);
+
+    nFreqs = nOutputBins;
+    fftSpectrumArray.resize(nFFTPoints);
+    fftSpectrumArrayAbs.resize(nFreqs);
+    maxFFTMagnitude = 0.0f;
+}
+
+void FFTSpectrum::prepareConstantQ()
+{
+    const double rate = fs / downSamplingRate;
+    const int binsPerOctave = juce::jmax(1, constantQ.binsPerOctave);
+    const double Q = 1.0 / (std::exp2(1.0 / binsPerOctave) - 1.0); // frequency over bandwidth
+    const int nBins = juce::jmax(1, (int) std::floor(binsPerOctave * std::log2(0.5 * rate / constantQ.minFrequency)));
+
+    // One FFT long enough for the lowest bin's kernel, whose window holds Q periods:
+    const int nFFTPoints = juce::jmin(juce::nextPowerOfTwo((int) std::ceil(Q * rate / constantQ.minFrequency)),
+                                      constantQ.maxFFTSize);
+    setFrameSize(nFFTPoints, nBins, nFFTPoints);
+    constantQValues.resize((size_t) nBins);
+
+    // The spectral kernel of bin k is the DFT of a Hann windowed complex exponential at its frequency,
+    // centred in the frame. That is three shifted Dirichlet kernels, so only the bins around the
+    // frequency (main lobe and first side lobes) are evaluated rather than transforming every kernel.
+    const double pi = juce::MathConstants<double>::pi;
+    auto dirichlet = [] (double theta, int M) {
+        // sum over n < M of exp(-i theta n)
+        const double half = 0.5 * theta;
+        const double s = std::sin(half);
+        const double magnitude = std::abs(s) < 1.0e-12 ? (double) M : std::sin(M * half) / s;
+        return std::polar(magnitude, -half * (M - 1));
+    };
+
+    kernelOffsets.assign(1, 0);
+    kernelBins.clear();
+    kernelValues.clear();
+    std::vector<std::complex<double>> kernel;
+    for (int k = 0; k < nBins; k++)
+    {
+        const double frequency = getFrequency(k);
+        const int M = juce::jlimit(2, nFFTPoints, (int) std::ceil(Q * rate / frequency)); // window length
+        const int start = (nFFTPoints - M) / 2;
+        const double omega = 2.0 * pi * frequency / rate;
+        const double alpha = 2.0 * pi / (M - 1);
+
+        const double centre = frequency / rate * nFFTPoints;
+        const int halfWidth = 4 * nFFTPoints / M + 2;
+        const int first = juce::jmax(0, (int) centre - halfWidth);
+        const int last = juce::jmin(nFFTPoints / 2, (int) centre + halfWidth);
+        kernel.resize((size_t) (last - first + 1));
+        double peak = 0.0;
+        for (int j = first; j <= last; j++)
+        {
+            const double theta = 2.0 * pi * j / nFFTPoints - omega;
+            const auto windowed = 0.5 * dirichlet(theta, M) - 0.25 * dirichlet(theta - alpha, M) - 0.25 * dirichlet(theta + alpha, M);
+            const auto value = windowed * std::polar(1.0 / M, -2.0 * pi * j * start / nFFTPoints);
+            kernel[(size_t) (j - first)] = value;
+            peak = juce::jmax(peak, std::abs(value));
+        }
 
-    audioSource->prepareToPlay(fftWindowSampleN, (double) fs);
+        for (int j = first; j <= last; j++)
+        {
+            const auto value = kernel[(size_t) (j - first)];
+            if (std::abs(value) < constantQ.kernelThreshold * peak) continue;
+            kernelBins.push_back(j);
+            kernelValues.push_back((std::complex<float>) (std::conj(value) / (double) nFFTPoints));
+        }
+        kernelOffsets.push_back((int) kernelBins.size());
+    }
 }
 void FFTSpectrum::removeAudioSource()
 {
-    if (audioSource.get()) audioSource->releaseResources();
-    playState = Stopped;
-    audioSource = nullptr;
+    setPlayState(Stopped);
+    mappedReader = nullptr;
+    streamReader = nullptr;
+    readAheadThread.stopThread(1000);
+}
+
+void FFTSpectrum::setLiveSource(float sampleRate)
+{
+    removeAudioSource();
+    fs = sampleRate;
+    nTotalSamples = 0;
+    duration = 0.0f;
+    maxFFTMagnitude = 0.0f;
+    readPosition = 0;
+    if (analysisMode != AnalysisMode::Linear) setAnalysisMode(analysisMode); // Kernels and filters depend on the sample rate
 }
 
 void FFTSpectrum::setTime(float t) 
 {
-    juce::int64 sampleIndex = (juce::int64) (t * fs);
-    audioSource->setNextReadPosition(sampleIndex);
+    readPosition = (juce::int64) (t * fs);
+}
+
+void FFTSpectrum::readDownSampled(float* dest, juce::int64 position, int nSamples)
+{
+    // The mapping is converted in place, or the decoder's buffers copied, for the analysed channel
+    // only (samples past the end are silent):
+    juce::AudioFormatReader* reader = mappedReader != nullptr ? mappedReader.get() : streamReader.get();
+    if (reader == nullptr)
+    {
+        std::fill(dest, dest + nSamples, 0.0f);
+        return;
+    }
+
+    // In chunks of the read buffer (inputBufferSize = fftWindowSampleN*downSamplingRate):
+    for (int done=0; done < nSamples; )
+    {
+        const int n = juce::jmin(nSamples - done, fftWindowSampleN);
+        reader->read(readChannels.data(), (int) readChannels.size(), position + downSamplingRate*done, n*downSamplingRate);
+        // skip every 2nd point:
+        for (int i=0; i < n; i++) dest[done + i] = readBuffer[(size_t) (downSamplingRate*i)];
+        done += n;
+    }
+}
+
+void FFTSpectrum::readSignal(float time, float* dest, int nSamples)
+{
+    readDownSampled(dest, (juce::int64) (time * fs), nSamples);
 }
 
 void FFTSpectrum::refreshFFT()
 {
-    audioSource->getNextAudioBlock(inputBufferInfo);
-    auto* leftBuffer = inputBufferInfo.buffer->getReadPointer(0);
+    ADDRSOUND_TRACE_SCOPE("FFTSpectrum::refreshFFT");
 
-    juce::Array<float> downSampled;
-    downSampled.resize(fftWindowSampleN);
-    // skip every 2nd point:
-    for (int i=0; i < fftWindowSampleN; i++) // fftWindowSampleN = inputBufferSize/downSamplingRate
-        downSampled.set(i, *(leftBuffer + downSamplingRate*i) );
+    readDownSampled(downSampled.data(), readPosition, fftWindowSampleN);
+    readPosition += inputBufferSize;
+    analyseDownSampled();
+}
 
-    auto nFFTPoints = nFreqs*2; // 2x DFT points to account for halving the symmetric spectrum
+void FFTSpectrum::refreshFFT(const float* input)
+{
+    ADDRSOUND_TRACE_SCOPE("FFTSpectrum::refreshFFT");
+    for (int i=0; i < fftWindowSampleN; i++) downSampled[(size_t) i] = input[downSamplingRate*i];
+    analyseDownSampled();
+}
+
+void FFTSpectrum::analyseDownSampled()
+{
+    auto* downSampledSignal = downSampled.data();
     auto* spectrumArr = fftSpectrumArray.getRawDataPointer();
-    auto* downSampledSignal = downSampled.getRawDataPointer();
+    const std::complex<float>* bins = spectrumArr;
 
-    hanningWindow(downSampledSignal, fftWindowSampleN); // Apply a Hanning window
+    if (analysisMode == AnalysisMode::ConstantQ)
+    {
+        // The kernels are windowed, so the frame isn't:
+        FFT(downSampledSignal, spectrumArr, fftSpectrumArray.size(), fftWindowSampleN);
+        for (int k=0; k<nFreqs; k++)
+        {
+            std::complex<float> sum = 0.0f;
+            for (int i = kernelOffsets[(size_t) k]; i < kernelOffsets[(size_t) k + 1]; i++)
+                sum += spectrumArr[kernelBins[(size_t) i]] * kernelValues[(size_t) i];
+            constantQValues[(size_t) k] = sum;
+        }
+        bins = constantQValues.data();
+    }
+    else if (analysisMode == AnalysisMode::Zoom)
+    {
+        // Filter at the decimated points only:
+        const int N = zoomFFTSize;
+        const int nTaps = (int) zoomTaps.size();
+        for (int m=0; m<N; m++)
+        {
+            const float* x = downSampledSignal + m * zoomDecimation;
+            std::complex<float> sum = 0.0f;
+            for (int t=0; t<nTaps; t++) sum += zoomTaps[(size_t) t] * x[t];
+            const auto y = sum * zoomRotations[(size_t) m];
+            zoomReal[(size_t) m] = y.real();
+            zoomImag[(size_t) m] = y.imag();
+        }
 
-    FFT(downSampledSignal, spectrumArr, nFFTPoints, fftWindowSampleN); 
+        // Complex FFT from two real ones: FFT(re + i*im) = FFT(re) + i*FFT(im)
+        FFT(zoomReal.data(), spectrumArr, N, N);
+        FFT(zoomImag.data(), zoomImagSpectrum.data(), N, N);
+        using namespace std::complex_literals;
+        for (int k=0; k<nFreqs; k++)
+        {
+            const int j = (zoomFirstBin + k + N) % N; // negative offsets wrap to the top half
+            zoomValues[(size_t) k] = spectrumArr[j] + 1.0if * zoomImagSpectrum[(size_t) j];
+        }
+        bins = zoomValues.data();
+    }
+    else
+    {
+        auto nFFTPoints = nFreqs*2; // 2x DFT points to account for halving the symmetric spectrum
+
+        hanningWindow(downSampledSignal, fftWindowSampleN); // Apply a Hanning window
+
+        FFT(downSampledSignal, spectrumArr, nFFTPoints, fftWindowSampleN); 
+    }
 
     if (!useGlobalNormalisation) maxFFTMagnitude = 0.0f; // Normalisation factor
     // Absolute value
     for (int i=0; i<nFreqs; i++)
     {
-        float abs = std::abs<float>(fftSpectrumArray[i]);
+        float abs = std::abs<float>(bins[i]);
         fftSpectrumArrayAbs.set(i,abs);
         if (abs > maxFFTMagnitude) maxFFTMagnitude = abs;
     }
@@ -207,6 +488,8 @@ void FFTSpectrum::FFT(const float* x_raw, std::complex<float>* X, int nDFTSample
 
 void FFTSpectrum::calcPeaks(Peaks& peaks)
 {
+    ADDRSOUND_TRACE_SCOPE("FFTSpectrum::calcPeaks");
+
     float* spectrumRaw = fftSpectrumArrayAbs.getRawDataPointer();
     int spectrumLen = fftSpectrumArrayAbs.size();
     std::vector<float> spectrum(spectrumRaw, spectrumRaw + spectrumLen);
@@ -214,4 +497,16 @@ void FFTSpectrum::calcPeaks(Peaks& peaks)
     for (int& index : peaks.indexs) peaks.values.push_back(spectrum[index]);
 
     DBG(juce::String(peaks.indexs.size()) + " peaks found!");
-}
\ No newline at end of file
+}
+
+void FFTSpectrum::fillPeakFrame(const Peaks& peaks, PeakFrame& frame)
+{
+    frame.nPeaks = juce::jmin(frame.getCapacity(), (int) peaks.indexs.size());
+    for (int i=0; i<frame.nPeaks; i++)
+    {
+        const int index = peaks.indexs[(size_t) i];
+        frame.frequencies[(size_t) i] = getFrequency(index);
+        frame.amplitudes[(size_t) i] = peaks.values[(size_t) i];
+        frame.phases[(size_t) i] = getPhase(index);
+    }
+}
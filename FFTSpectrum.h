@@ -6,7 +6,7 @@
 #include <stack>
 #include <vector>
 
-#include <juce_audio_utils/juce_audio_utils.h>
+#include <juce_audio_formats/juce_audio_formats.h>
 #include <PeakFinder.h>
 
 #include "Spectrum.h"
@@ -20,37 +20,112 @@ public:
 
     float getFrequency(int index) override;
     float getMagnitude(int fIndex) override;
+    float getPhase(int fIndex);
+    float getNormalisationFactor() const {return maxFFTMagnitude;} // the magnitudes were divided by this
 
     float getWindowPeriodSeconds();
-    
-    juce::AudioSourceChannelInfo* getInputBufferContainer();
+
+    // Linear: nFq bins evenly spaced up to Nyquist (of the down sampled signal).
+    // ConstantQ: bins spaced logarithmically from minFrequency, each as wide as a fixed fraction of
+    // its frequency, like the notes of a scale. They are computed from one larger FFT with
+    // precomputed sparse spectral kernels (Brown & Puckette), which changes getNFreqs() and the
+    // window length.
+    // Zoom: zoomFFTSize bins across the zoom band only. The band is mixed down to 0 Hz, low-pass
+    // filtered and decimated, so a small complex FFT resolves it as finely as a full band FFT many
+    // times larger. The window (and so the resolution) is capped at maxZoomWindowSeconds.
+    // Mode and band changes are made whilst no one else is using the spectrum (e.g. the worker is stopped).
+    enum class AnalysisMode {Linear, ConstantQ, Zoom};
+    struct ConstantQSettings
+    {
+        float minFrequency = 55.0f; // A1
+        int binsPerOctave = 24;
+        float kernelThreshold = 0.01f; // kernel values below this fraction of each kernel's peak are dropped
+        int maxFFTSize = 1 << 15; // lower bins are widened rather than exceed this
+    };
+    void setAnalysisMode(AnalysisMode mode, const ConstantQSettings& settings);
+    void setAnalysisMode(AnalysisMode mode) {setAnalysisMode(mode, constantQ);}
+    AnalysisMode getAnalysisMode() const {return analysisMode;}
+    void setZoomBand(juce::Range<float> band);
 
     void setTime(float t) override;
 
-    void addAudioSource(juce::AudioFormatReader* reader, bool ownsReader);
+    // WAV/AIFF files are memory mapped and read in place; other formats are decoded ahead on a
+    // background thread. Only the given channel is analysed. Returns false if unreadable.
+    bool addAudioSource(const juce::File& file, int channel = 0);
+    bool isMemoryMapped() const {return mappedReader != nullptr;}
 
     void removeAudioSource();
 
+    // Live input instead of a file: nothing is read, each frame is given to refreshFFT(input)
+    void setLiveSource(float sampleRate);
+    int getFrameInputSamples() const {return inputBufferSize;} // source samples per analysis frame
+    int getDownSamplingRate() const {return downSamplingRate;}
+
+    // The analysed (down sampled) signal itself, e.g. for pitch detection. Samples past the end are silent.
+    float getSignalSampleRate() const {return fs / (float) downSamplingRate;}
+    void readSignal(float time, float* dest, int nSamples);
+
     void refreshFFT();
+    void refreshFFT(const float* input); // getFrameInputSamples() samples at the source's rate
 
     void calcPeaks(Peaks& peaks);
+    void fillPeakFrame(const Peaks& peaks, PeakFrame& frame); // Keeps the first frame.getCapacity() peaks
+
+    // Shared with the streaming analysis (AnalysisPipeline):
+    static void hanningWindow(float* x, int N);
+    static void FFT(const float* x_raw, std::complex<float>* X, int nDFTSamples, int nSignalSamples);
 
 private:
-    void hanningWindow(float* x, int N);
 
-    void FFT(const float* x_raw, std::complex<float>* X, int nDFTSamples, int nSignalSamples);
+    void readDownSampled(float* dest, juce::int64 position, int nSamples); // of the analysed channel, from position (in source samples)
+    void analyseDownSampled();
+    void setFrameSize(int windowSamples, int nOutputBins, int nFFTPoints);
+    void prepareConstantQ();
+    void prepareZoom();
 
     int fftWindowSampleN; // Must be power of 2
+    const int linearWindowSampleN;
+    const int nLinearBins; // half the linear FFT size
     int downSamplingRate; // Used to restrict the spectrum below fs/2
     int inputBufferSize;
     float fs;
 
     juce::int64 nTotalSamples;
-    std::unique_ptr<juce::AudioFormatReaderSource> audioSource;
-    juce::AudioSourceChannelInfo inputBufferInfo;
+    juce::int64 readPosition;
+    int analysedChannel;
+
+    std::unique_ptr<juce::MemoryMappedAudioFormatReader> mappedReader;
+
+    juce::TimeSliceThread readAheadThread;
+    std::unique_ptr<juce::AudioFormatReader> streamReader; // Fallback for compressed formats
+    std::vector<float> readBuffer; // inputBufferSize samples of the analysed channel, from either reader
+    std::vector<float*> readChannels; // only the analysed channel is non-null, so only it is converted
+
+    std::vector<float> downSampled;
 
     juce::Array<std::complex<float>> fftSpectrumArray;
     juce::Array<float> fftSpectrumArrayAbs;
+
+    // Constant-Q: bin k is the sum over kernelBins[kernelOffsets[k] .. kernelOffsets[k+1]) of the
+    // FFT times kernelValues (the conjugate spectral kernel, divided by the FFT size).
+    AnalysisMode analysisMode = AnalysisMode::Linear;
+    ConstantQSettings constantQ;
+    std::vector<int> kernelOffsets, kernelBins;
+    std::vector<std::complex<float>> kernelValues;
+    std::vector<std::complex<float>> constantQValues;
+
+    // Zoom: output m of the decimated band is rotations[m] times the sum over zoomTaps of the
+    // frame from m*zoomDecimation (the taps are the low-pass filter mixed down by the band centre).
+    juce::Range<float> zoomBand;
+    const int zoomFFTSize = 512;
+    const float maxZoomWindowSeconds = 1.0f;
+    int zoomDecimation = 1;
+    int zoomFirstBin = 0; // relative to the band centre
+    float zoomStartFrequency = 0.0f, zoomBinWidth = 1.0f;
+    std::vector<std::complex<float>> zoomTaps, zoomRotations;
+    std::vector<float> zoomReal, zoomImag;
+    std::vector<std::complex<float>> zoomImagSpectrum; // fftSpectrumArray holds that of zoomReal
+    std::vector<std::complex<float>> zoomValues;
     float maxFFTMagnitude;
     const bool useGlobalNormalisation;
     
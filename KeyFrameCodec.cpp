@@ -0,0 +1,130 @@
+#include "KeyFrameCodec.h"
+#include "Tracer.h"
+
+juce::MemoryBlock KeyFrameCodec::encode(const float* magnitudes, int nKeyFrames, int nFreqs, int bits)
+{
+    jassert(isValidBits(bits) && nKeyFrames > 0 && nFreqs > 0);
+    const size_t n = (size_t) nKeyFrames * (size_t) nFreqs;
+    const int mask = (1 << bits) - 1;
+
+    float loudest = 0.0f;
+    for (size_t i = 0; i < n; i++) loudest = juce::jmax(loudest, magnitudes[i]);
+    const float maxDecibels = loudest > 0.0f ? 20.0f * std::log10(loudest) : 0.0f;
+    const float minDecibels = maxDecibels - rangeDecibels;
+    const float step = getStepDecibels(bits);
+
+    // 0 is silence, 1..mask cover minDecibels..maxDecibels:
+    std::vector<int> quantised(n);
+    for (size_t i = 0; i < n; i++)
+    {
+        const float decibels = magnitudes[i] > 0.0f ? 20.0f * std::log10(magnitudes[i]) : minDecibels - step;
+        quantised[i] = decibels < minDecibels - step / 2 ? 0
+                     : 1 + juce::jlimit(0, mask - 1, juce::roundToInt((decibels - minDecibels) / step));
+    }
+
+    std::vector<juce::uint8> planes(bits > 8 ? 2*n : n);
+    for (size_t index = 0; index < n; index++)
+    {
+        const size_t i = index % (size_t) nFreqs;
+        const int prediction = index >= (size_t) nFreqs ? quantised[index - (size_t) nFreqs] // Previous keyframe
+                             : i > 0 ? quantised[index - 1] : 0; // Previous partial
+        // Residuals wrap around, and 0, -1, 1, -2, 2... become the codes 0, 1, 2, 3, 4...
+        const int residual = (quantised[index] - prediction) & mask;
+        const int signedResidual = residual > mask / 2 ? residual - mask - 1 : residual;
+        const int code = signedResidual >= 0 ? 2 * signedResidual : -2 * signedResidual - 1;
+        planes[index] = (juce::uint8) code;
+        if (bits > 8) planes[n + index] = (juce::uint8) (code >> 8);
+    }
+
+    juce::MemoryOutputStream output;
+    output.writeInt(magic);
+    output.writeInt(version);
+    output.writeInt(bits);
+    output.writeInt(nKeyFrames);
+    output.writeInt(nFreqs);
+    output.writeFloat(maxDecibels);
+    {
+        juce::GZIPCompressorOutputStream zipper(output, 9); // Written once, read many times
+        zipper.write(planes.data(), planes.size());
+    }
+    return output.getMemoryBlock();
+}
+
+bool KeyFrameCodec::decode(const juce::MemoryBlock& data, float* magnitudes, int nKeyFrames, int nFreqs)
+{
+    ADDRSOUND_TRACE_SCOPE("KeyFrameCodec::decode");
+    if (data.getSize() < (size_t) headerSize) return false;
+    juce::MemoryInputStream input(data, false);
+    const int dataMagic = input.readInt();
+    const int dataVersion = input.readInt();
+    const int bits = input.readInt();
+    const int dataKeyFrames = input.readInt();
+    const int dataFreqs = input.readInt();
+    const float maxDecibels = input.readFloat();
+    if (dataMagic != magic || dataVersion != version || !isValidBits(bits)
+        || dataKeyFrames != nKeyFrames || dataFreqs != nFreqs || nKeyFrames <= 0 || nFreqs <= 0)
+        return false;
+
+    const size_t n = (size_t) nKeyFrames * (size_t) nFreqs;
+    std::vector<juce::uint8> planes(bits > 8 ? 2*n : n);
+    juce::GZIPDecompressorInputStream unzipper(input);
+    if (unzipper.read(planes.data(), (int) planes.size()) != (int) planes.size()) return false;
+
+    const int mask = (1 << bits) - 1;
+    const float* levels = getLevels(bits).data();
+    const float gain = std::pow(10.0f, maxDecibels / 20.0f);
+    std::vector<int> quantised((size_t) nFreqs, 0);
+    int* q = quantised.data();
+
+    for (int kF = 0; kF < nKeyFrames; kF++)
+    {
+        const juce::uint8* low = planes.data() + (size_t) kF * (size_t) nFreqs;
+        const juce::uint8* high = bits > 8 ? low + n : nullptr;
+        if (kF == 0)
+        {
+            // Across partials:
+            int previous = 0;
+            for (int i = 0; i < nFreqs; i++)
+            {
+                const int code = bits > 8 ? low[i] | high[i] << 8 : low[i];
+                previous = (previous + ((code >> 1) ^ -(code & 1))) & mask;
+                q[i] = previous;
+            }
+        }
+        else if (bits > 8)
+        {
+            // Whole keyframe against the previous one:
+            for (int i = 0; i < nFreqs; i++)
+            {
+                const int code = low[i] | high[i] << 8;
+                q[i] = (q[i] + ((code >> 1) ^ -(code & 1))) & mask;
+            }
+        }
+        else
+        {
+            for (int i = 0; i < nFreqs; i++)
+            {
+                const int code = low[i];
+                q[i] = (q[i] + ((code >> 1) ^ -(code & 1))) & mask;
+            }
+        }
+
+        float* row = magnitudes + (size_t) kF * (size_t) nFreqs;
+        for (int i = 0; i < nFreqs; i++) row[i] = gain * levels[q[i]];
+    }
+    return true;
+}
+
+// Magnitude of every quantised value relative to the loudest, shared by every decode
+const std::vector<float>& KeyFrameCodec::getLevels(int bits)
+{
+    static const auto makeLevels = [] (int b) {
+        std::vector<float> levels((size_t) 1 << b);
+        levels[0] = 0.0f;
+        for (size_t q = 1; q < levels.size(); q++)
+            levels[q] = std::pow(10.0f, ((float) (q - 1) * getStepDecibels(b) - rangeDecibels) / 20.0f);
+        return levels;
+    };
+    static const std::vector<float> tables[3] = {makeLevels(8), makeLevels(12), makeLevels(16)};
+    return tables[(bits - 8) / 4];
+}
@@ -0,0 +1,35 @@
+#pragma once
+
+#include <juce_core/juce_core.h>
+
+// Compact encoding of keyframe magnitudes, for libraries of many .addrsound patches.
+// Magnitudes are quantised to 8, 12 or 16 bits in dB below the loudest one (0 keeps silence
+// exact), each keyframe is delta-coded against the previous one (the first across partials), the
+// residuals are zigzagged into small codes split into byte planes, and the planes are deflated.
+// Decoding undoes the deltas a whole keyframe at a time and dequantises through a table, in loops
+// the compiler vectorises.
+//
+// Layout (little endian): magic, version, bits, nKeyFrames, nFreqs, maxDecibels, then the zlib
+// stream of the nKeyFrames x nFreqs codes (keyframe-major): the low byte plane, followed by the
+// high byte plane when bits > 8.
+class KeyFrameCodec
+{
+public:
+    static bool isValidBits(int bits) {return bits == 8 || bits == 12 || bits == 16;}
+
+    // magnitudes: nKeyFrames x nFreqs, keyframe-major
+    static juce::MemoryBlock encode(const float* magnitudes, int nKeyFrames, int nFreqs, int bits);
+    // Returns false if data isn't an encoding of nKeyFrames x nFreqs magnitudes
+    static bool decode(const juce::MemoryBlock& data, float* magnitudes, int nKeyFrames, int nFreqs);
+
+    // Quantisation range below the loudest magnitude; anything quieter is stored as silence
+    static constexpr float rangeDecibels = 120.0f;
+    static float getStepDecibels(int bits) {return rangeDecibels / (float) ((1 << bits) - 2);}
+
+private:
+    static const std::vector<float>& getLevels(int bits);
+
+    static constexpr int magic = 0x434b4441; // "ADKC"
+    static constexpr int version = 1;
+    static constexpr int headerSize = 6*4;
+};
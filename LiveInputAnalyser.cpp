@@ -0,0 +1,117 @@
+#include "LiveInputAnalyser.h"
+#include "FFTSpectrum.h"
+#include "Tracer.h"
+
+LiveInputAnalyser::LiveInputAnalyser(FFTSpectrum& s)
+    : juce::Thread("Live Input Analysis"), spectrum(s), ring((size_t) ringSize), fifo(ringSize) {}
+
+LiveInputAnalyser::~LiveInputAnalyser()
+{
+    stop();
+}
+
+void LiveInputAnalyser::start()
+{
+    // Preallocate everything for the spectrum's current bins, so analysis never reallocates:
+    const auto nFreqs = (size_t) spectrum.getNFreqs();
+    frames.forEachBuffer([nFreqs] (Frame& frame) {
+        frame.magnitudes.resize(nFreqs);
+        frame.peaks.indexs.reserve(nFreqs);
+        frame.peaks.values.reserve(nFreqs);
+    });
+    pitchDetector.prepare(spectrum.getSignalSampleRate());
+    pitchFrame.resize((size_t) pitchDetector.getFrameSamples());
+    const int pitchInputSamples = (int) pitchFrame.size() * spectrum.getDownSamplingRate();
+    history.assign((size_t) juce::jmax(spectrum.getFrameInputSamples(), pitchInputSamples), 0.0f);
+
+    receivedSamples = 0;
+    pushedSamples = 0;
+    droppedSamples = 0;
+    fifo.reset(); // The ring itself is never reallocated, so a late push can't write outside it
+    startThread();
+    startTimerHz(displayRate);
+}
+
+void LiveInputAnalyser::stop()
+{
+    stopTimer();
+    stopThread(2000);
+}
+
+void LiveInputAnalyser::pushInput(const float* samples, int nSamples) noexcept
+{
+    int start1, size1, start2, size2;
+    fifo.prepareToWrite(nSamples, start1, size1, start2, size2);
+    std::copy(samples, samples + size1, ring.begin() + start1);
+    std::copy(samples + size1, samples + size1 + size2, ring.begin() + start2);
+    fifo.finishedWrite(size1 + size2);
+    pushedSamples += size1 + size2;
+    if (size1 + size2 < nSamples) droppedSamples.fetch_add(nSamples - size1 - size2, std::memory_order_relaxed);
+}
+
+void LiveInputAnalyser::run()
+{
+    const int hopSamples = spectrum.getFrameInputSamples() / 2;
+    int newSamples = 0;
+    while (! threadShouldExit())
+    {
+        // Everything that has arrived. If the analysis fell behind, only the latest frame is analysed.
+        const int nReady = fifo.getNumReady();
+        if (nReady > 0)
+        {
+            int start1, size1, start2, size2;
+            fifo.prepareToRead(nReady, start1, size1, start2, size2);
+            appendToHistory(ring.data() + start1, size1);
+            appendToHistory(ring.data() + start2, size2);
+            fifo.finishedRead(size1 + size2);
+            newSamples += nReady;
+        }
+
+        if (newSamples < hopSamples)
+        {
+            wait(2); // Polled, as the audio thread can't wake this one without taking a lock
+            continue;
+        }
+        newSamples = 0;
+        analyse();
+    }
+}
+
+void LiveInputAnalyser::appendToHistory(const float* samples, int nSamples)
+{
+    if (nSamples <= 0) return;
+    const int size = (int) history.size();
+    const int n = juce::jmin(nSamples, size);
+    std::copy(history.begin() + n, history.end(), history.begin());
+    std::copy(samples + nSamples - n, samples + nSamples, history.end() - n);
+    receivedSamples += nSamples;
+}
+
+void LiveInputAnalyser::analyse()
+{
+    ADDRSOUND_TRACE_SCOPE("LiveInputAnalyser::analyse");
+    spectrum.refreshFFT(history.data() + history.size() - (size_t) spectrum.getFrameInputSamples());
+
+    Frame& frame = frames.getWriteBuffer();
+    frame.inputPosition = receivedSamples - spectrum.getFrameInputSamples() / 2;
+    frame.time = (float) ((double) frame.inputPosition / (spectrum.getSignalSampleRate() * spectrum.getDownSamplingRate()));
+    for (size_t i = 0; i < frame.magnitudes.size(); i++) frame.magnitudes[i] = spectrum.getMagnitude((int) i);
+    frame.peaks.indexs.clear();
+    frame.peaks.values.clear();
+    spectrum.calcPeaks(frame.peaks);
+
+    // The pitch frame is the end of the history, down sampled like the spectrum's:
+    const int downSamplingRate = spectrum.getDownSamplingRate();
+    const float* pitchInput = history.data() + history.size() - pitchFrame.size() * (size_t) downSamplingRate;
+    for (size_t i = 0; i < pitchFrame.size(); i++) pitchFrame[i] = pitchInput[i * (size_t) downSamplingRate];
+    frame.fundamental = pitchDetector.detect(pitchFrame.data());
+
+    if (onFrameAnalysed) onFrameAnalysed(frame);
+    frames.publish();
+}
+
+void LiveInputAnalyser::timerCallback()
+{
+    if (frames.update() && onFrameReady)
+        onFrameReady(frames.getReadBuffer());
+}
@@ -0,0 +1,54 @@
+#pragma once
+
+#include <juce_events/juce_events.h>
+
+#include "RefAnalysisWorker.h"
+
+// Analyses live audio input continuously through the reference FFTSpectrum (in whichever analysis
+// mode it's in). The audio thread only copies input into a lock-free single producer, single
+// consumer ring buffer; a background thread analyses a frame whenever half a window of new input
+// has arrived, and the most recent frame reaches the message thread at display rate.
+class LiveInputAnalyser : private juce::Thread, private juce::Timer
+{
+public:
+    using Frame = RefAnalysisWorker::Frame;
+
+    LiveInputAnalyser(FFTSpectrum& spectrum);
+    ~LiveInputAnalyser() override;
+
+    // Message thread, whilst the audio thread isn't pushing input. The spectrum must have a live
+    // source at the input's sample rate, and mustn't be touched by anyone else whilst running.
+    void start();
+    void stop();
+    bool isRunning() const {return isThreadRunning();}
+
+    // Audio thread: never blocks or allocates. Input that doesn't fit (the analysis fell behind) is dropped.
+    void pushInput(const float* samples, int nSamples) noexcept;
+    int getDroppedSamples() const {return droppedSamples.load();}
+    juce::int64 getPushedSamples() const noexcept {return pushedSamples;} // audio thread only
+
+    // Called on the analysis thread after every frame
+    std::function<void (const Frame&)> onFrameAnalysed;
+    // Called on the message thread with the most recent frame, at most displayRate times a second
+    std::function<void (const Frame&)> onFrameReady;
+
+private:
+    void run() override;
+    void timerCallback() override;
+    void appendToHistory(const float* samples, int nSamples);
+    void analyse();
+
+    FFTSpectrum& spectrum;
+    static constexpr int ringSize = 1 << 16; // samples, several times longer than the analysis takes
+    std::vector<float> ring;
+    juce::AbstractFifo fifo;
+    std::atomic<int> droppedSamples {0};
+    juce::int64 pushedSamples = 0; // audio thread only, so it's comparable with Frame::inputPosition there
+
+    std::vector<float> history; // latest input, oldest first, long enough for a frame and a pitch frame
+    juce::int64 receivedSamples = 0; // by the analysis thread, dropped samples aside
+    TripleBuffer<Frame> frames;
+    PitchDetector pitchDetector;
+    std::vector<float> pitchFrame;
+    const int displayRate = 30; // Hz
+};
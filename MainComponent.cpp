@@ -1,18 +1,26 @@
 #include "MainComponent.h"
+#include "AnalysisPipeline.h"
+#include "SpectrogramView.h"
+#include "PartialTracker.h"
 
 //==============================================================================
 MainComponent::MainComponent()
     : additiveSpectrum(30, 440, 0.5f, 10),
       refSpectrum(512, 512, 2),
+      morphTarget(30, 440, 0.5f, 10),
       spectrumEditor(additiveSpectrum, refSpectrum),
       timeSlider(additiveSpectrum, spectrumEditor),
-      midiPlayer(additiveSpectrum, timeSlider, effectSettings.getControlValue(EffectSettings::ControlID::Midi))
+      refAnalysisWorker(refSpectrum),
+      liveInputAnalyser(refSpectrum),
+      midiPlayer(additiveSpectrum, timeSlider, effectSettings.getControlValue(EffectSettings::ControlID::Midi),
+                 effectSettings.getControlValue(EffectSettings::ControlID::Morph))
 {
     level = 0.0f;
+    sampleRate = 0.0;
 
     createWaveTable();
 
-    setSize (500, 450);
+    setSize (500, 470);
     setAudioChannels(0,2); // Only outputs
 
     setWantsKeyboardFocus(true);
@@ -22,29 +30,61 @@ MainComponent::MainComponent()
     addMouseListener(&spectrumEditor, false);
     addAndMakeVisible(timeSlider);
     addMouseListener(&timeSlider, false);
+    additiveSpectrum.onEdited = [this] {triggerAsyncUpdate();}; // Coalesces a drag's edits into one rebuild
+
+    renderPool.onWorkerStart = [this] (int workerIndex) {realtimeSetup.promoteCurrentThread(workerIndex);};
 
     addAndMakeVisible(toolsButton);
     toolsButton.onChange = [this] {toolsMenuSelect();};
 
-    circularPointerBufferIndex = 0;
+    refAnalysisWorker.onFrameAnalysed = [this] (const RefAnalysisWorker::Frame& frame) {
+        publishRefPeaks(frame.peaks);
+    };
+    refAnalysisWorker.onFrameReady = [this] (const RefAnalysisWorker::Frame& frame) {showRefFrame(frame);};
+    liveInputAnalyser.onFrameAnalysed = [this] (const LiveInputAnalyser::Frame& frame) {publishLivePeaks(frame);};
+    liveInputAnalyser.onFrameReady = [this] (const LiveInputAnalyser::Frame& frame) {
+        showRefFrame(frame);
+        if (liveResynthesis.load()) updateLiveLatency();
+    };
     addAndMakeVisible(refAudioPositionSlider);
     refAudioPositionSlider.setTextValueSuffix(" s");
     refAudioPositionSlider.setTextBoxStyle(juce::Slider::TextBoxBelow, false, 100, 20);
     refAudioPositionSlider.setEnabled(false);
     addMouseListener(&refAudioPositionSlider, false);
+    addChildComponent(liveLatencyLabel); // Only shown whilst resynthesising live input
 
     addAndMakeVisible(effectSettings);
     effectSettings.addCustomCallback(EffectSettings::ControlID::Gain, [this] (std::atomic<double>& delta) {
         spectrumEditor.multiplyAllPoints(delta);
         spectrumEditor.repaint();
     });
+    effectSettings.addCustomCallback(EffectSettings::ControlID::PickRadius, [this] (std::atomic<double>& radius) {
+        spectrumEditor.setPickRadius((float) radius.load());
+    });
+    effectSettings.addCustomCallback(EffectSettings::ControlID::MinPartials, [this] (std::atomic<double>&) {updateGovernorLimits();});
+    effectSettings.addCustomCallback(EffectSettings::ControlID::MaxLoad, [this] (std::atomic<double>&) {updateGovernorLimits();});
+    addAndMakeVisible(governorLabel);
+    startTimerHz(4);
 
     setKeyboardNoteBindings();    
+
+   #if ADDRSOUND_TRACING
+    Tracer::getInstance().start(juce::File::getSpecialLocation(juce::File::tempDirectory).getChildFile("AddrSound.trace.json"));
+   #endif
 }
 
 MainComponent::~MainComponent()
 {
     shutdownAudio();
+    refAnalysisWorker.stop(); // before the peaks it publishes to are destroyed
+    liveInputAnalyser.stop();
+
+   #if ADDRSOUND_TRACING
+    Tracer::getInstance().stop();
+   #endif
+   #if ADDRSOUND_RT_SANITIZER
+    DBG(juce::String(RealtimeSanitizer::getViolationCount()) + " real-time violations on the audio thread");
+   #endif
 }
 
 //==============================================================================
@@ -53,8 +93,6 @@ void MainComponent::createWaveTable()
 {
     sineTable.setSize(1, (int) tableSize + 1);
     auto* samples = sineTable.getWritePointer(0);
-    squareTable.setSize(1, (int) tableSize + 1);
-    auto* squareSamples = squareTable.getWritePointer(0);
     auto angleDelta = juce::MathConstants<double>::twoPi / (double) (tableSize-1);
     auto currentAngle = 0.0;
 
@@ -62,75 +100,162 @@ void MainComponent::createWaveTable()
     {
         auto sample = std::sin(currentAngle);
         samples[i] = (float) sample;
-        squareSamples[i] = (float) std::tanh(50*sample); // mimick a square
         currentAngle += angleDelta;
     }
     samples[tableSize] = samples[0];
-    squareSamples[tableSize] = samples[0];
 }
 
-void MainComponent::prepareToPlay (int /*samplesPerBlockExpected*/, double sampleRate)
+void MainComponent::prepareToPlay (int samplesPerBlockExpected, double newSampleRate)
 {
+    sampleRate = newSampleRate;
+    oscillators.clear(); // The device is restarted when loading a spectrum
     for(auto i=0; i < additiveSpectrum.getNFreqs(); i++)
     {
-        auto* oscillator = new WavetableOscillator(sineTable, squareTable, (float) sampleRate);
+        auto* oscillator = new WavetableOscillator(sineTable, (float) sampleRate);
         oscillator->setAmplitude(additiveSpectrum.getMagnitude(i));
         oscillator->setFrequency(additiveSpectrum.getFrequency(i));
         oscillator->setVibratoFactor(effectSettings.getControlValue(EffectSettings::ControlID::Vibrato));
-        oscillator->setDistortionFactor(effectSettings.getControlValue(EffectSettings::ControlID::Distortion));
         oscillators.add(oscillator);
     }
     level = 0.5f / (float) additiveSpectrum.getNFreqs();
+    partialAmplitudes.resize((size_t) oscillators.size());
+    morphMagnitudes.resize((size_t) oscillators.size());
+    governor.prepare(oscillators.size(), sampleRate);
 
+    // The analysis worker and live input publish reference peaks, so they are paused whilst they're reallocated:
+    const bool refAnalysisRunning = refAnalysisWorker.isRunning();
+    const bool liveAnalysisRunning = liveInputAnalyser.isRunning();
+    refAnalysisWorker.stop();
+    liveInputAnalyser.stop();
+    refPeakFrames.forEachBuffer([this] (Spectrum::PeakFrame& frame) {frame.allocate(oscillators.size());});
+    liveTransform.prepare(oscillators.size(), sampleRate);
+    if (refAnalysisRunning) refAnalysisWorker.start();
+    if (liveAnalysisRunning) liveInputAnalyser.start();
+    oscillatorAssigner.prepare(oscillators.size());
+    wasPlayingReference = false;
+
+    // Worker threads only exist when there are enough partials for them to be used:
+    if (oscillators.size() >= parallelRenderThreshold)
+        renderPool.start(juce::jlimit(1, 4, juce::SystemStats::getNumCpus() - 1), samplesPerBlockExpected / sampleRate);
+    else
+        renderPool.stop();
+    workerMixBuffers.setSize(renderPool.getNumWorkers(), samplesPerBlockExpected);
+
+    distortion.prepare(samplesPerBlockExpected, level * (float) oscillators.size());
     reverb.setSampleRate(sampleRate);
+
+    if (realtimeSetup.isEnabled()) prepareRealtime();
+}
+
+// Runs before the first callback: lock and prefault everything the audio thread touches
+void MainComponent::prepareRealtime()
+{
+    realtimeSetup.unlockRegions(); // Whatever was locked for the previous patch
+
+    realtimeSetup.lockRegion(sineTable.getWritePointer(0), sizeof(float) * (size_t) sineTable.getNumSamples());
+    additiveSpectrum.visitKeyFrameData([this] (void* data, size_t numBytes) {realtimeSetup.lockRegion(data, numBytes);});
+    realtimeSetup.lockRegion(partialAmplitudes.data(), sizeof(float) * partialAmplitudes.size());
+    realtimeSetup.lockRegion(morphMagnitudes.data(), sizeof(float) * morphMagnitudes.size());
+    for (int worker = 0; worker < workerMixBuffers.getNumChannels(); worker++)
+        realtimeSetup.lockRegion(workerMixBuffers.getWritePointer(worker), sizeof(float) * (size_t) workerMixBuffers.getNumSamples());
+    audioThreadPromoted = false;
+
+    juce::String problems = (realtimeSetup.checkPrivileges() + "\n" + realtimeSetup.getStatusReport()).trim();
+    if (problems.isNotEmpty())
+    {
+        juce::Logger::writeToLog("Real-time setup: " + problems);
+        juce::AlertWindow::showMessageBoxAsync(juce::AlertWindow::AlertIconType::WarningIcon,
+            "Real-time Mode Not Fully Available", problems);
+    }
 }
 
 void MainComponent::getNextAudioBlock (const juce::AudioSourceChannelInfo& bufferToFill)
 {
+    ADDRSOUND_TRACE_SCOPE("getNextAudioBlock");
+    ADDRSOUND_REALTIME_SCOPE;
+    governor.beginBlock();
+
+    if (!audioThreadPromoted && realtimeSetup.isEnabled())
+    {
+        realtimeSetup.promoteCurrentThread(0);
+        audioThreadPromoted = true;
+    }
+
     auto* leftBuffer = bufferToFill.buffer->getWritePointer(0,bufferToFill.startSample);
     auto* rightBuffer = bufferToFill.buffer->getWritePointer(1,bufferToFill.startSample);
+    // The input arrives in the same buffer, so it's captured before the output overwrites it:
+    if (liveInput.load(std::memory_order_acquire))
+        liveInputAnalyser.pushInput(leftBuffer, bufferToFill.numSamples);
     bufferToFill.clearActiveBufferRegion();
 
-    if (refPlaying.load(std::memory_order_acquire) == true) // Play reference audio
+    const bool resynthesisingLive = liveResynthesis.load(std::memory_order_acquire);
+    const bool playingReference = refPlaying.load(std::memory_order_acquire) || resynthesisingLive;
+    int nOscillators;
+    if (playingReference) // Play reference audio
     {
-        std::shared_ptr<Spectrum::Peaks> peaks = std::atomic_load_explicit(&fftPeaks, std::memory_order_acquire);
-        auto nOscillators = std::min<int>(oscillators.size(), (int) peaks->indexs.size());
+        // Peaks continue the nearest oscillators; the composition's partials fade out for a block first:
+        if (!wasPlayingReference) oscillatorAssigner.reset();
+        else if (refPeakFrames.update() || !oscillatorAssigner.hasFrame())
+        {
+            const auto& frame = refPeakFrames.getReadBuffer();
+            oscillatorAssigner.assign(frame);
+            // From the centre of the analysed input window to the end of this block:
+            if (resynthesisingLive)
+                liveLatencySamples.store((int) (liveInputAnalyser.getPushedSamples() - frame.inputPosition) + bufferToFill.numSamples,
+                                         std::memory_order_relaxed);
+        }
+        wasPlayingReference = true;
+
+        nOscillators = oscillators.size();
         for(auto oIndex=0; oIndex < nOscillators; oIndex++)
         {
-            auto peakIndex = peaks->indexs[oIndex];
-            auto peakValue = peaks->values[oIndex];
             auto* oscillator = oscillators.getUnchecked(oIndex);
-            oscillator->setAmplitude(peakValue);
-            oscillator->setFrequency(refSpectrum.getFrequency(peakIndex));
-
-            for (auto sample = 0; sample < bufferToFill.numSamples; sample++)
-            {
-                auto current = 0.0f;
-                current += oscillator->getNextSample() * level;
-                leftBuffer[sample] += current;
-                rightBuffer[sample] += current;
-            }
+            const float amplitude = oscillatorAssigner.getAmplitude(oIndex);
+            const float frequency = amplitude > 0.0f ? oscillatorAssigner.getFrequency(oIndex) : oscillator->getTargetFrequency();
+            oscillator->glideTo(frequency, amplitude, bufferToFill.numSamples);
+            partialAmplitudes[(size_t) oIndex] = amplitude;
         }
     }
     else // Play additive composition (Fourier Series)
     {
-        auto nOscillators = oscillators.size();
+        wasPlayingReference = false;
+        nOscillators = oscillators.size();
+        // Morphing evaluates every partial from the precompiled tables in one pass:
+        const float morph = (float) effectSettings.getControlValue(EffectSettings::ControlID::Morph)->load();
+        const bool morphing = morph > 0.0f && morphEngine.evaluate(additiveSpectrum.getTime(), morph, morphMagnitudes.data(), nOscillators);
         for(auto oIndex=0; oIndex < nOscillators; oIndex++)
         {
             auto* oscillator = oscillators.getUnchecked(oIndex);
-            oscillator->setAmplitude(additiveSpectrum.getMagnitude(oIndex));
+            float magnitude = morphing ? morphMagnitudes[(size_t) oIndex] : additiveSpectrum.getMagnitude(oIndex);
+            oscillator->setAmplitude(magnitude);
             oscillator->setFrequency(additiveSpectrum.getFrequency(oIndex));
-
-            for (auto sample = 0; sample < bufferToFill.numSamples; sample++)
-            {
-                auto current = 0.0f; 
-                // Playing additive oscillators
-                
-                current += oscillator->getNextSample() * level;
-                leftBuffer[sample] += current;
-                rightBuffer[sample] += current;
-            }
+            partialAmplitudes[(size_t) oIndex] = magnitude;
         }
+    }
+
+    // Under CPU pressure the governor fades out the quietest partials:
+    governor.updateGains(partialAmplitudes.data(), nOscillators, bufferToFill.numSamples);
+    if (nOscillators >= parallelRenderThreshold && renderPool.getNumWorkers() > 1
+        && bufferToFill.numSamples <= workerMixBuffers.getNumSamples())
+    {
+        partialRenderJob.nOscillators = nOscillators;
+        partialRenderJob.numSamples = bufferToFill.numSamples;
+        renderPool.run(partialRenderJob);
+
+        // Sum the worker mixes in a fixed order so the output doesn't depend on thread timing:
+        for (int worker = 0; worker < workerMixBuffers.getNumChannels(); worker++)
+            juce::FloatVectorOperations::add(leftBuffer, workerMixBuffers.getReadPointer(worker), bufferToFill.numSamples);
+    }
+    else
+    {
+        renderOscillators(0, nOscillators, leftBuffer, bufferToFill.numSamples);
+    }
+    distortion.process(leftBuffer, bufferToFill.numSamples,
+                       (float) effectSettings.getControlValue(EffectSettings::ControlID::Distortion)->load());
+    juce::FloatVectorOperations::copy(rightBuffer, leftBuffer, bufferToFill.numSamples);
+
+    if (!playingReference)
+    {
         // Process reverb:
         std::atomic<double>* reverbFactor = effectSettings.getControlValue(EffectSettings::ControlID::Reverb);
         if (reverbFactor)
@@ -140,13 +265,76 @@ void MainComponent::getNextAudioBlock (const juce::AudioSourceChannelInfo& buffe
             reverb.setParameters(reverbParameters);
             reverb.processStereo(leftBuffer, rightBuffer, bufferToFill.numSamples);
         }
+
+        // Envelope playback clock (the GUI only reads the published time to draw the cursor):
+        additiveSpectrum.advancePlayback((float) (bufferToFill.numSamples / sampleRate));
     }
+
+    governor.endBlock(bufferToFill.numSamples);
+}
+
+// Producer side of refPeakFrames: the analysis worker, or the message thread whilst it is stopped
+void MainComponent::publishRefPeaks(const Spectrum::Peaks& peaks)
+{
+    refSpectrum.fillPeakFrame(peaks, refPeakFrames.getWriteBuffer());
+    refPeakFrames.publish();
+}
+
+// Live input peaks, transformed by the live resynthesis controls (on the analysis thread):
+void MainComponent::publishLivePeaks(const LiveInputAnalyser::Frame& frame)
+{
+    Spectrum::PeakFrame& peakFrame = refPeakFrames.getWriteBuffer();
+    refSpectrum.fillPeakFrame(frame.peaks, peakFrame);
+    PartialTransform::Settings settings;
+    settings.pitchShift = (float) effectSettings.getControlValue(EffectSettings::ControlID::PitchShift)->load();
+    settings.harmonicSnap = (float) effectSettings.getControlValue(EffectSettings::ControlID::HarmonicSnap)->load();
+    settings.maxPartials = juce::roundToInt(effectSettings.getControlValue(EffectSettings::ControlID::PartialLimit)->load());
+    liveTransform.apply(settings, peakFrame, frame.fundamental);
+    peakFrame.inputPosition = frame.inputPosition;
+    refPeakFrames.publish();
+}
+
+// Adds oscillators [firstOscillator, lastOscillator) to the mono mixBuffer:
+void MainComponent::renderOscillators(int firstOscillator, int lastOscillator, float* mixBuffer, int numSamples)
+{
+    for(auto oIndex=firstOscillator; oIndex < lastOscillator; oIndex++)
+    {
+        if (governor.isSilenced(oIndex)) continue; // Shed partial
+        auto* oscillator = oscillators.getUnchecked(oIndex);
+        float gain = governor.getStartGain(oIndex) * level;
+        const float gainStep = governor.getGainStep(oIndex) * level;
+
+        for (auto sample = 0; sample < numSamples; sample++)
+        {
+            mixBuffer[sample] += oscillator->getNextSample() * gain;
+            gain += gainStep;
+        }
+    }
+}
+
+void MainComponent::PartialRenderJob::render(int worker, int nWorkers) noexcept
+{
+    ADDRSOUND_REALTIME_SCOPE;
+    auto* mixBuffer = owner.workerMixBuffers.getWritePointer(worker);
+    juce::FloatVectorOperations::clear(mixBuffer, numSamples);
+    owner.renderOscillators(nOscillators * worker / nWorkers, nOscillators * (worker + 1) / nWorkers, mixBuffer, numSamples);
 }
 
 
 void MainComponent::releaseResources()
 {
     juce::Logger::getCurrentLogger()->writeToLog ("Releasing audio resources");
+    renderPool.stop();
+    juce::Logger::getCurrentLogger()->writeToLog ("Callback load " + juce::String(governor.getLoad(), 2)
+                                                  + ", rendering " + juce::String(governor.getPartialCap()) + " partials (degradation "
+                                                  + juce::String(governor.getDegradationLevel(), 2) + ")");
+    juce::Logger::getCurrentLogger()->writeToLog (governor.getHistogramReport());
+    if (realtimeSetup.isEnabled())
+    {
+        juce::String status = realtimeSetup.getStatusReport();
+        juce::Logger::getCurrentLogger()->writeToLog ("Real-time mode: " + juce::String(realtimeSetup.getNumThreadsPromoted()) + " threads promoted"
+                                                      + (status.isEmpty() ? juce::String() : "\n" + status));
+    }
 }
 
 
@@ -169,6 +357,8 @@ void MainComponent::resized()
     effectSettings.setBounds(50, 10, 300, 30);
     toolsButton.setBounds(350, 10, 100, 30);
     refAudioPositionSlider.setBounds(50, 400, 400, 40);
+    liveLatencyLabel.setBounds(50, 380, 400, 20);
+    governorLabel.setBounds(50, 445, 400, 20);
 }
 
 
@@ -185,6 +375,27 @@ MainComponent::ToolsButton::ToolsButton()
     addItem(juce::String("Distortion"), ItemIDs::DistortionID);
     addItem(juce::String("Reverb"), ItemIDs::ReverbID);
     addItem(juce::String("Load Reference Spectrum"), ItemIDs::LoadRefID);
+    addItem(juce::String("Analyse Long Recording"), ItemIDs::AnalyseID);
+    addItem(juce::String("View Spectrogram"), ItemIDs::SpectrogramID);
+    addItem(juce::String("Convert Reference to Spectrum"), ItemIDs::ConvertRefID);
+    addItem(juce::String("Simplify Keyframes"), ItemIDs::SimplifyID);
+    addItem(juce::String("Constant-Q Reference Analysis"), ItemIDs::ConstantQID);
+    addItem(juce::String("Zoom Reference to Visible Band"), ItemIDs::ZoomRefID);
+    addItem(juce::String("Auto-Align Reference to Harmonics"), ItemIDs::AutoAlignID);
+    addItem(juce::String("Set Note to Reference Pitch"), ItemIDs::RefPitchID);
+    setItemEnabled(ItemIDs::RefPitchID, false); // Until auto-align detects one
+    addItem(juce::String("Analyse Live Input"), ItemIDs::LiveInputID);
+    addItem(juce::String("Resynthesise Live Input"), ItemIDs::LiveResynthID);
+    addItem(juce::String("Live Pitch Shift"), ItemIDs::PitchShiftID);
+    addItem(juce::String("Live Harmonic Snap"), ItemIDs::HarmonicSnapID);
+    addItem(juce::String("Live Partial Limit"), ItemIDs::PartialLimitID);
+    addItem(juce::String("Load Morph Target"), ItemIDs::MorphTargetID);
+    addItem(juce::String("Morph"), ItemIDs::MorphID);
+    addItem(juce::String("Distortion Oversampling: ") + DistortionStage::getOptionName(DistortionStage::defaultOption), ItemIDs::OversamplingID);
+    addItem(juce::String("Save Compressed Spectrum (12 bit)"), ItemIDs::SaveCompressedID);
+    addItem(juce::String("Partial Pick Radius"), ItemIDs::PickRadiusID);
+    addItem(juce::String("Quality Governor Min Partials"), ItemIDs::MinPartialsID);
+    addItem(juce::String("Quality Governor Max Load"), ItemIDs::MaxLoadID);
     
 }
 void MainComponent::toolsMenuSelect()
@@ -217,10 +428,78 @@ void MainComponent::toolsMenuSelect()
             break;
         case ToolsButton::ItemIDs::LoadRefID:   
             loadReferenceFile();
+            break;
+        case ToolsButton::ItemIDs::AnalyseID:
+            analyseRecording();
+            break;
+        case ToolsButton::ItemIDs::SpectrogramID:
+            viewSpectrogram();
+            break;
+        case ToolsButton::ItemIDs::ConvertRefID:
+            convertReferenceToSpectrum();
+            break;
+        case ToolsButton::ItemIDs::SimplifyID:
+            simplifyKeyFrames();
+            break;
+        case ToolsButton::ItemIDs::ConstantQID:
+            toggleConstantQ();
+            break;
+        case ToolsButton::ItemIDs::ZoomRefID:
+            zoomReference();
+            break;
+        case ToolsButton::ItemIDs::AutoAlignID:
+            toggleAutoAlign();
+            break;
+        case ToolsButton::ItemIDs::RefPitchID:
+            applyRefPitch();
+            break;
+        case ToolsButton::ItemIDs::LiveInputID:
+            toggleLiveInput();
+            break;
+        case ToolsButton::ItemIDs::LiveResynthID:
+            toggleLiveResynthesis();
+            break;
+        case ToolsButton::ItemIDs::PitchShiftID:
+            effectSettings.showControl(EffectSettings::ControlID::PitchShift);
+            break;
+        case ToolsButton::ItemIDs::HarmonicSnapID:
+            effectSettings.showControl(EffectSettings::ControlID::HarmonicSnap);
+            break;
+        case ToolsButton::ItemIDs::PartialLimitID:
+            effectSettings.showControl(EffectSettings::ControlID::PartialLimit);
+            break;
+        case ToolsButton::ItemIDs::MorphTargetID:
+            loadMorphTarget();
+            break;
+        case ToolsButton::ItemIDs::MorphID:
+            effectSettings.showControl(EffectSettings::ControlID::Morph);
+            break;
+        case ToolsButton::ItemIDs::OversamplingID:
+        {
+            // Cycles through the factors and filter types:
+            const int option = (distortion.getOption() + 1) % DistortionStage::numOptions;
+            distortion.setOption(option);
+            toolsButton.changeItemText(ToolsButton::ItemIDs::OversamplingID,
+                                       "Distortion Oversampling: " + DistortionStage::getOptionName(option));
+            effectSettings.showControl(EffectSettings::ControlID::Distortion);
+            break;
+        }
+        case ToolsButton::ItemIDs::SaveCompressedID:
+            saveSpectrum(12);
+            break;
+        case ToolsButton::ItemIDs::PickRadiusID:
+            effectSettings.showControl(EffectSettings::ControlID::PickRadius);
+            break;
+        case ToolsButton::ItemIDs::MinPartialsID:
+            effectSettings.showControl(EffectSettings::ControlID::MinPartials);
+            break;
+        case ToolsButton::ItemIDs::MaxLoadID:
+            effectSettings.showControl(EffectSettings::ControlID::MaxLoad);
+            break;
     }
     toolsButton.setText("Tools");
 }
-void MainComponent::saveSpectrum()
+void MainComponent::saveSpectrum(int compressedBits)
 {
     juce::FileChooser fC("Save spectrum file as", juce::File(), "*.addrsound");
     if (fC.browseForFileToSave(true))
@@ -231,7 +510,7 @@ void MainComponent::saveSpectrum()
         {
             fileStream.setPosition(0);
             fileStream.truncate();
-            additiveSpectrum.saveSpectrum(fileStream);
+            additiveSpectrum.saveSpectrum(fileStream, compressedBits);
             fileStream.flush();
         }
     }
@@ -245,28 +524,46 @@ void MainComponent::loadSpectrum()
         juce::File file = fC.getResult();
         juce::FileInputStream fileStream(file);
         if (fileStream.openedOk()) additiveSpectrum.loadSpectrum(fileStream);
+        if (morphEngine.isReady()) morphEngine.build(additiveSpectrum, morphTarget);
     }
     deviceManager.restartLastAudioDevice(); // Start sound thread again
     spectrumEditor.initPoints();
     spectrumEditor.repaint();
     timeSlider.repaint();
 }
+// The patch that the Morph control (or the mod wheel in a MIDI file) morphs the composition towards
+void MainComponent::loadMorphTarget()
+{
+    juce::FileChooser fC("Load spectrum to morph towards", juce::File(), "*.addrsound");
+    if (!fC.browseForFileToOpen()) return;
+    juce::FileInputStream fileStream(fC.getResult());
+    if (!fileStream.openedOk()) return;
+
+    morphTarget.loadSpectrum(fileStream); // Only the tables built from it reach the audio thread
+    morphEngine.build(additiveSpectrum, morphTarget);
+    effectSettings.showControl(EffectSettings::ControlID::Morph);
+}
+
 void MainComponent::loadReferenceFile()
 {
     juce::FileChooser fC("Choose Reference Audio File");
     if (fC.browseForFileToOpen())
     {
+        if (liveInputAnalyser.isRunning()) toggleLiveInput(); // The file replaces the live input
         refAudioPositionSlider.setEnabled(false);
         juce::File file = fC.getResult();
-        juce::AudioFormatManager formatManager;
-        formatManager.registerBasicFormats();
-        juce::AudioFormatReader* reader = formatManager.createReaderFor(file);
-        if (reader != nullptr)
+        refAnalysisWorker.stop(); // Nothing else may use refSpectrum whilst it's analysing
+        if (refSpectrum.addAudioSource(file))
         {
-            refSpectrum.removeAudioSource();
-            refSpectrum.addAudioSource(reader, true);
+            refFile = file;
             refSpectrum.setTime(0.0f);
             refSpectrum.refreshFFT();
+
+            // Peaks for the audio thread are always available before reference playback starts:
+            Spectrum::Peaks peaks;
+            refSpectrum.calcPeaks(peaks);
+            publishRefPeaks(peaks);
+
             spectrumEditor.addRefSpectrum();
             spectrumEditor.repaint();
             
@@ -274,24 +571,16 @@ void MainComponent::loadReferenceFile()
             refAudioPositionSlider.setValue(0.0);
             refAudioPositionSlider.setRange(0.0, refSpectrum.getDuration(), refSpectrum.getWindowPeriodSeconds()/4);
             refAudioPositionSlider.onValueChange = [this] {
-                refSpectrum.setTime((float) refAudioPositionSlider.getValue());                
-                refSpectrum.refreshFFT();
-
-                std::shared_ptr<Spectrum::Peaks> peaks(new Spectrum::Peaks());
-                refSpectrum.calcPeaks(*peaks);
-                std::atomic_store_explicit(&fftPeaks,peaks, std::memory_order_release);
-                circularPointerBuffer[circularPointerBufferIndex++] = peaks;
-                circularPointerBufferIndex %= circularPointerBuffer.size();
+                // Analysed in the background; only the latest requested position is analysed
+                refAnalysisWorker.requestAnalysis((float) refAudioPositionSlider.getValue());
                 refPlaying.store(true, std::memory_order_release);
-
-                spectrumEditor.refreshPoints(true, peaks.get());
-                spectrumEditor.repaint();
             };
             
             refAudioPositionSlider.onDragEnd = [this] {
                 refPlaying.store(false, std::memory_order_release);
             };
             refAudioPositionSlider.setEnabled(true);
+            refAnalysisWorker.start();
         }
         else
         {
@@ -302,6 +591,376 @@ void MainComponent::loadReferenceFile()
     }
 }
 
+namespace
+{
+    // Runs an AnalysisPipeline over a whole file behind a cancellable progress window
+    class AnalysisProgress : public juce::ThreadWithProgressWindow
+    {
+    public:
+        AnalysisProgress(const juce::String& title, juce::AudioFormatReader* r, const AnalysisPipeline::Settings& settings)
+            : juce::ThreadWithProgressWindow(title, true, true), pipeline(settings), reader(r) {}
+
+        void run() override
+        {
+            pipeline.start(reader, sink);
+            while (!pipeline.waitForCompletion(100))
+            {
+                if (threadShouldExit() || pipeline.wasCancelled()) {pipeline.cancel(); break;}
+                setProgress(pipeline.getProgress());
+                setStatusMessage(juce::String(pipeline.getNumFramesAnalysed()) + " frames, "
+                                 + juce::String(pipeline.getRealtimeFactor(), 1) + "x real time");
+            }
+            pipeline.stop(); // The sink is done with the caller's output once runThread returns
+            completed = !pipeline.wasCancelled();
+            juce::Logger::getCurrentLogger()->writeToLog(getAlertWindow()->getName() + ": " + pipeline.getReport());
+        }
+
+        AnalysisPipeline pipeline;
+        AnalysisPipeline::Sink sink; // Called on the pipeline's sink thread
+        bool completed = false;
+
+    private:
+        juce::AudioFormatReader* reader; // Owned by the pipeline once started
+    };
+
+    juce::AudioFormatReader* createReaderOrWarn(const juce::File& file)
+    {
+        juce::AudioFormatManager formatManager;
+        formatManager.registerBasicFormats();
+        juce::AudioFormatReader* reader = formatManager.createReaderFor(file);
+        if (reader == nullptr)
+        {
+            juce::AlertWindow::showMessageBox(juce::AlertWindow::AlertIconType::WarningIcon,
+                "Error Reading Audio File",
+                "The file selected (" + file.getFileName() + ") could not be read as an audio file.");
+        }
+        return reader;
+    }
+}
+
+// Streams a recording of any length through the analysis pipeline, writing every frame's peaks to a CSV file
+void MainComponent::analyseRecording()
+{
+    juce::FileChooser inputChooser("Choose Recording to Analyse");
+    if (!inputChooser.browseForFileToOpen()) return;
+    juce::File input = inputChooser.getResult();
+
+    juce::FileChooser outputChooser("Save peaks as", input.withFileExtension("csv"), "*.csv");
+    if (!outputChooser.browseForFileToSave(true)) return;
+    juce::File output = outputChooser.getResult();
+
+    juce::AudioFormatReader* reader = createReaderOrWarn(input);
+    if (reader == nullptr) return;
+
+    output.deleteFile();
+    juce::FileOutputStream stream(output);
+    if (!stream.openedOk()) {delete reader; return;}
+    stream << "time,frequency,magnitude\n";
+
+    AnalysisProgress progress("Analysing " + input.getFileName(), reader, AnalysisPipeline::Settings());
+    progress.sink = [&progress, &stream] (const AnalysisPipeline::Frame& frame) {
+        for (size_t i=0; i < frame.peaks.indexs.size(); i++)
+            stream << frame.time << "," << progress.pipeline.getFrequency(frame.peaks.indexs[i]) << "," << frame.peaks.values[i] << "\n";
+    };
+    progress.runThread();
+}
+
+// Shows how the spectrum of a recording evolves. The spectrogram is analysed once into a tiled
+// store next to the recording, so reopening it (and zooming around it) needs no more FFTs.
+void MainComponent::viewSpectrogram()
+{
+    juce::FileChooser chooser("Choose Recording");
+    if (!chooser.browseForFileToOpen()) return;
+    juce::File input = chooser.getResult();
+    juce::File storeFile = input.withFileExtension("aspg");
+
+    if (!storeFile.existsAsFile() || storeFile.getLastModificationTime() < input.getLastModificationTime())
+    {
+        juce::AudioFormatReader* reader = createReaderOrWarn(input);
+        if (reader == nullptr) return;
+
+        AnalysisPipeline::Settings settings;
+        settings.normalise = false; // Keep loudness changes over time
+        const double sampleRate = reader->sampleRate;
+        SpectrogramStore::Writer writer(storeFile, settings.nFreqs,
+                                        (float) (settings.hopSamples * settings.downSamplingRate / sampleRate),
+                                        (float) (sampleRate / settings.downSamplingRate / 2),
+                                        settings.windowSamples / 4.0f); // A full scale sine through the Hanning window
+        if (!writer.openedOk()) {delete reader; return;}
+
+        AnalysisProgress progress("Analysing " + input.getFileName(), reader, settings);
+        progress.sink = [&writer] (const AnalysisPipeline::Frame& frame) {writer.addFrame(frame.magnitudes.data());};
+        progress.runThread();
+        if (!writer.finish() || !progress.completed)
+        {
+            storeFile.deleteFile();
+            return;
+        }
+    }
+
+    auto* view = new SpectrogramView();
+    if (!view->open(storeFile))
+    {
+        delete view;
+        juce::AlertWindow::showMessageBox(juce::AlertWindow::AlertIconType::WarningIcon,
+            "Error Reading Spectrogram", "The spectrogram (" + storeFile.getFileName() + ") could not be read.");
+        return;
+    }
+    view->setSize(800, 400);
+
+    juce::DialogWindow::LaunchOptions options;
+    options.content.setOwned(view);
+    options.dialogTitle = "Spectrogram: " + input.getFileName();
+    options.resizable = true;
+    options.useNativeTitleBar = true;
+    options.launchAsync();
+}
+
+// Replaces the spectrum with keyframes from the partials tracked through the reference recording
+void MainComponent::convertReferenceToSpectrum()
+{
+    juce::File file = refFile;
+    if (!file.existsAsFile())
+    {
+        juce::FileChooser fC("Choose Reference Audio File");
+        if (!fC.browseForFileToOpen()) return;
+        file = fC.getResult();
+    }
+
+    PartialTracker::Settings settings;
+    settings.nHarmonics = additiveSpectrum.getNFreqs();
+    PartialTracker tracker(settings);
+    if (!tracker.analyse(file, additiveSpectrum.getFrequency(0)))
+    {
+        juce::AlertWindow::showMessageBox(juce::AlertWindow::AlertIconType::WarningIcon,
+            "Error Reading Audio File",
+            "The file selected (" + file.getFileName() + ") could not be read as an audio file.");
+        return;
+    }
+    juce::Logger::getCurrentLogger()->writeToLog("Partial tracking of " + file.getFileName() + ": " + tracker.getReport());
+
+    deviceManager.closeAudioDevice(); // Stop sound thread to allow for the change of time-critical data structures:
+    tracker.writeKeyFrames(additiveSpectrum);
+    if (morphEngine.isReady()) morphEngine.build(additiveSpectrum, morphTarget);
+    deviceManager.restartLastAudioDevice(); // Start sound thread again
+    spectrumEditor.initPoints();
+    spectrumEditor.repaint();
+    timeSlider.repaint();
+}
+
+void MainComponent::simplifyKeyFrames()
+{
+    juce::AlertWindow askTolerance("Simplify Keyframes",
+        "Keyframes are removed where interpolating their neighbours stays within this magnitude of every partial:",
+        juce::AlertWindow::AlertIconType::QuestionIcon);
+    askTolerance.addTextEditor("tolerance", "0.01", "Tolerance");
+    askTolerance.addButton("Simplify", 1, juce::KeyPress(juce::KeyPress::returnKey));
+    askTolerance.addButton("Cancel", 0, juce::KeyPress(juce::KeyPress::escapeKey));
+    if (askTolerance.runModalLoop() == 0) return;
+    const float tolerance = juce::jmax(0.0f, askTolerance.getTextEditorContents("tolerance").getFloatValue());
+
+    deviceManager.closeAudioDevice(); // Stop sound thread to allow for the change of time-critical data structures:
+    const auto result = additiveSpectrum.simplifyKeyFrames(tolerance);
+    if (morphEngine.isReady()) morphEngine.build(additiveSpectrum, morphTarget);
+    deviceManager.restartLastAudioDevice(); // Start sound thread again
+    spectrumEditor.refreshPoints();
+    spectrumEditor.repaint();
+    timeSlider.repaint();
+
+    juce::AlertWindow::showMessageBoxAsync(juce::AlertWindow::AlertIconType::InfoIcon, "Keyframes Simplified",
+        juce::String(result.nBefore) + " keyframes reduced to " + juce::String(result.nAfter)
+        + " (" + juce::String(result.getCompressionRatio(), 1) + ":1), maximum error " + juce::String(result.maxError, 4) + ".");
+}
+
+// Switches the reference from linear FFT bins to log spaced constant-Q bins (drawn by frequency on
+// the partials' axis, so the harmonics of the note sit under the partials), or back to linear from
+// any other mode
+void MainComponent::toggleConstantQ()
+{
+    setRefAnalysisMode(refSpectrum.getAnalysisMode() == FFTSpectrum::AnalysisMode::Linear
+                       ? FFTSpectrum::AnalysisMode::ConstantQ : FFTSpectrum::AnalysisMode::Linear);
+}
+
+// Analyses just the band of the reference currently on screen at high resolution (zoom-FFT),
+// which can be zoomed into again
+void MainComponent::zoomReference()
+{
+    refSpectrum.setZoomBand(spectrumEditor.getVisibleRefFrequencyRange());
+    setRefAnalysisMode(FFTSpectrum::AnalysisMode::Zoom);
+    spectrumEditor.resetRefDisplay(); // The new bins span the whole width
+    spectrumEditor.repaint();
+}
+
+void MainComponent::toggleAutoAlign()
+{
+    autoAlignRef = !autoAlignRef;
+    toolsButton.changeItemText(ToolsButton::ItemIDs::AutoAlignID,
+                               autoAlignRef ? "Stop Auto-Aligning Reference" : "Auto-Align Reference to Harmonics");
+    if (autoAlignRef && refAnalysisWorker.isRunning())
+        refAnalysisWorker.requestAnalysis((float) refAudioPositionSlider.getValue()); // Align straight away
+    if (!autoAlignRef)
+    {
+        detectedRefPitch = 0.0f;
+        toolsButton.changeItemText(ToolsButton::ItemIDs::RefPitchID, "Set Note to Reference Pitch");
+        toolsButton.setItemEnabled(ToolsButton::ItemIDs::RefPitchID, false);
+    }
+}
+
+// Retunes the composition to the reference pitch that auto-align detected (and saves with it)
+void MainComponent::applyRefPitch()
+{
+    if (detectedRefPitch <= 0.0f) return;
+    additiveSpectrum.setFirstFrequency(detectedRefPitch);
+    spectrumEditor.refreshRefAxis();
+    spectrumEditor.alignRefToHarmonics(detectedRefPitch);
+    spectrumEditor.repaint();
+}
+
+void MainComponent::toggleLiveInput()
+{
+    if (liveInputAnalyser.isRunning())
+    {
+        if (liveResynthesis.load()) toggleLiveResynthesis();
+        liveInput.store(false, std::memory_order_release);
+        liveInputAnalyser.stop();
+        DBG(juce::String(liveInputAnalyser.getDroppedSamples()) + " live input samples dropped");
+        setAudioChannels(0,2); // Only outputs again
+        toolsButton.changeItemText(ToolsButton::ItemIDs::LiveInputID, "Analyse Live Input");
+        return;
+    }
+
+    if (juce::RuntimePermissions::isRequired(juce::RuntimePermissions::recordAudio)
+        && !juce::RuntimePermissions::isGranted(juce::RuntimePermissions::recordAudio))
+    {
+        juce::RuntimePermissions::request(juce::RuntimePermissions::recordAudio, [this] (bool granted) {
+            if (granted) startLiveInput();
+        });
+        return;
+    }
+    startLiveInput();
+}
+
+// Opens the input channels and analyses the first of them in place of the reference file
+void MainComponent::startLiveInput()
+{
+    setAudioChannels(2,2);
+    auto* device = deviceManager.getCurrentAudioDevice();
+    if (device == nullptr || device->getActiveInputChannels().isZero())
+    {
+        setAudioChannels(0,2);
+        juce::AlertWindow::showMessageBox(juce::AlertWindow::AlertIconType::WarningIcon,
+            "No Audio Input", "The audio device has no input to analyse.");
+        return;
+    }
+
+    refAnalysisWorker.stop(); // Nothing else may use refSpectrum whilst it's analysing
+    refPlaying.store(false, std::memory_order_release);
+    refAudioPositionSlider.setEnabled(false);
+    refSpectrum.setLiveSource((float) device->getCurrentSampleRate());
+    spectrumEditor.addRefSpectrum();
+    spectrumEditor.repaint();
+
+    liveInputAnalyser.start();
+    liveInput.store(true, std::memory_order_release);
+    toolsButton.changeItemText(ToolsButton::ItemIDs::LiveInputID, "Stop Live Input");
+}
+
+// Plays the live input's partials, as transformed by the live controls, on the oscillators
+void MainComponent::toggleLiveResynthesis()
+{
+    const bool enable = !liveResynthesis.load();
+    if (enable && !liveInputAnalyser.isRunning())
+    {
+        toggleLiveInput();
+        if (!liveInputAnalyser.isRunning()) return; // No input (or waiting for permission)
+    }
+    liveResynthesis.store(enable, std::memory_order_release);
+    liveLatencyLabel.setText("", juce::dontSendNotification);
+    liveLatencyLabel.setVisible(enable);
+    toolsButton.changeItemText(ToolsButton::ItemIDs::LiveResynthID, enable ? "Stop Live Resynthesis" : "Resynthesise Live Input");
+}
+
+void MainComponent::updateLiveLatency()
+{
+    // Measured by the audio thread, plus the device's own buffering either side. The analysis
+    // part is bounded by half a window (its centre) plus a hop, plus the time to analyse it:
+    auto* device = deviceManager.getCurrentAudioDevice();
+    if (device == nullptr || sampleRate <= 0.0) return;
+    const int deviceSamples = device->getInputLatencyInSamples() + device->getOutputLatencyInSamples();
+    const double msPerSample = 1000.0 / sampleRate;
+    const double measured = (liveLatencySamples.load() + deviceSamples) * msPerSample;
+    const double window = refSpectrum.getFrameInputSamples() * msPerSample;
+    const double buffers = (device->getCurrentBufferSizeSamples() + deviceSamples) * msPerSample;
+    liveLatencyLabel.setText("Live latency " + juce::String(measured, 1) + " ms (window/2 + hop: " + juce::String(window, 1)
+                             + " ms, buffers: " + juce::String(buffers, 1) + " ms)", juce::dontSendNotification);
+}
+
+// Partials are shed above the Max Load fraction of the callback deadline and restored 0.3 below it
+void MainComponent::updateGovernorLimits()
+{
+    const float maxLoad = (float) effectSettings.getControlValue(EffectSettings::ControlID::MaxLoad)->load();
+    governor.setLimits((int) effectSettings.getControlValue(EffectSettings::ControlID::MinPartials)->load(),
+                       maxLoad, maxLoad - 0.3f);
+}
+
+void MainComponent::timerCallback()
+{
+    governorLabel.setText("Callback load " + juce::String(juce::roundToInt(governor.getLoad() * 100.0f)) + "%, rendering "
+                          + juce::String(governor.getPartialCap()) + " partials (degradation "
+                          + juce::String(governor.getDegradationLevel(), 2) + ")", juce::dontSendNotification);
+}
+
+void MainComponent::handleAsyncUpdate()
+{
+    if (morphEngine.isReady()) morphEngine.build(additiveSpectrum, morphTarget);
+}
+
+void MainComponent::showRefFrame(const RefAnalysisWorker::Frame& frame)
+{
+    if (autoAlignRef && frame.fundamental > 0.0f)
+    {
+        // The reference's harmonics onto the composition's. The note is left alone whilst scrubbing:
+        spectrumEditor.alignRefToHarmonics(frame.fundamental);
+        detectedRefPitch = frame.fundamental;
+        toolsButton.changeItemText(ToolsButton::ItemIDs::RefPitchID,
+                                   "Set Note to Reference Pitch (" + juce::String(detectedRefPitch, 1) + " Hz)");
+        toolsButton.setItemEnabled(ToolsButton::ItemIDs::RefPitchID, true);
+    }
+    spectrumEditor.refreshPoints(true, &frame.peaks, frame.magnitudes.data());
+    spectrumEditor.repaint();
+}
+
+// Changes the reference bins, re-analysing the current position
+void MainComponent::setRefAnalysisMode(FFTSpectrum::AnalysisMode mode)
+{
+    const bool refLoaded = refAnalysisWorker.isRunning();
+    const bool live = liveInputAnalyser.isRunning();
+    refAnalysisWorker.stop(); // Nothing else may use refSpectrum whilst its bins change
+    liveInput.store(false, std::memory_order_release);
+    liveInputAnalyser.stop();
+    refSpectrum.setAnalysisMode(mode);
+    toolsButton.changeItemText(ToolsButton::ItemIDs::ConstantQID,
+                               mode == FFTSpectrum::AnalysisMode::Linear ? "Constant-Q Reference Analysis" : "Linear Reference Analysis");
+    if (live)
+    {
+        spectrumEditor.addRefSpectrum();
+        liveInputAnalyser.start();
+        liveInput.store(true, std::memory_order_release);
+    }
+    if (!refLoaded) return;
+
+    refSpectrum.setTime((float) refAudioPositionSlider.getValue());
+    refSpectrum.refreshFFT();
+    Spectrum::Peaks peaks;
+    refSpectrum.calcPeaks(peaks);
+    publishRefPeaks(peaks);
+
+    spectrumEditor.addRefSpectrum();
+    spectrumEditor.repaint();
+    refAudioPositionSlider.setRange(0.0, refSpectrum.getDuration(), refSpectrum.getWindowPeriodSeconds()/4);
+    refAnalysisWorker.start();
+}
+
 void MainComponent::loadMidi()
 {
     midiPlayer.stopTimer(); // ensure player thread has stopped, as the following will delete current midi data
@@ -356,8 +1015,10 @@ void MainComponent::loadMidi()
     }
 }
 
-MainComponent::MidiTimer::MidiTimer(AdditiveSpectrum& additiveSpectrum, TimeSlider& timeSlider, std::atomic<double>* midiControlState)
-    : additiveSpectrum(additiveSpectrum), timeSlider(timeSlider), midiControlState(midiControlState) {}
+MainComponent::MidiTimer::MidiTimer(AdditiveSpectrum& additiveSpectrum, TimeSlider& timeSlider, std::atomic<double>* midiControlState,
+                                    std::atomic<double>* morphControlState)
+    : additiveSpectrum(additiveSpectrum), timeSlider(timeSlider), midiControlState(midiControlState),
+      morphControlState(morphControlState) {}
 
 void MainComponent::MidiTimer::play(const juce::MidiMessageSequence *track)
 {
@@ -380,11 +1041,16 @@ void MainComponent::MidiTimer::scheduleNextNote()
     {
         auto* event = midiTrack->getEventPointer(eventIndex);
         auto* msg = &event->message;
-        if (msg->isNoteOn())
+        const bool isMorph = msg->isControllerOfType(morphController);
+        if (msg->isNoteOn() || isMorph)
         {
             double timeToWait = msg->getTimeStamp() - currentTime; // in seconds
             int timeToWaitMilliseconds = (int) (timeToWait*1000);
-            if (timeToWaitMilliseconds == 0) continue; // Skip polyphony
+            if (timeToWaitMilliseconds == 0) // Skip polyphony, but not morph changes
+            {
+                if (isMorph) *morphControlState = msg->getControllerValue() / 127.0;
+                continue;
+            }
             currentMsg = msg;
             eventIndex++; // Have to increment before timer blocks this UI thread (if first note)
             this->startTimer(timeToWaitMilliseconds);
@@ -396,6 +1062,8 @@ void MainComponent::MidiTimer::scheduleNextNote()
 
 void MainComponent::MidiTimer::hiResTimerCallback()
 {
+    ADDRSOUND_TRACE_SCOPE("MidiTimer::hiResTimerCallback");
+
     // Check if user has requested to pause/stop playback:
     if (*midiControlState != (double) EffectSettings::PlaybackControlState::Play)
     {
@@ -403,8 +1071,14 @@ void MainComponent::MidiTimer::hiResTimerCallback()
         if (*midiControlState == (double) EffectSettings::PlaybackControlState::Stop) this->stopTimer();
         return;
     }
-    // Play Midi note:
-    if (currentMsg)
+    // Morph change or Midi note:
+    if (currentMsg && currentMsg->isController())
+    {
+        *morphControlState = currentMsg->getControllerValue() / 127.0;
+        currentTime = currentMsg->getTimeStamp();
+        scheduleNextNote();
+    }
+    else if (currentMsg)
     {
         float freq = (float) juce::MidiMessage::getMidiNoteInHertz(currentMsg->getNoteNumber());
         additiveSpectrum.setFirstFrequency((float) freq);
@@ -10,16 +10,29 @@
 #include "AdditiveSpectrum.h"
 #include "SpectrumEditor.h"
 #include "FFTSpectrum.h"
+#include "RefAnalysisWorker.h"
+#include "LiveInputAnalyser.h"
+#include "TripleBuffer.h"
+#include "OscillatorAssigner.h"
+#include "PartialTransform.h"
+#include "MorphEngine.h"
 #include "TimeSlider.h"
 #include "WaveTableOscillator.h"
+#include "DistortionStage.h"
 #include "EffectSettings.h"
+#include "QualityGovernor.h"
+#include "RenderPool.h"
+#include "RealtimeSanitizer.h"
+#include "RealtimeSetup.h"
+#include "Tracer.h"
 
 //==============================================================================
 /*
     This component lives inside our window, and this is where you should put all
     your controls and content.
 */
-class MainComponent   : public juce::AudioAppComponent, public juce::KeyListener
+class MainComponent   : public juce::AudioAppComponent, public juce::KeyListener, private juce::Timer,
+                        private juce::AsyncUpdater
 {
 public:
     //==============================================================================
@@ -31,15 +44,34 @@ public:
     void releaseResources() override;
 
     void createWaveTable();
+    void renderOscillators(int firstOscillator, int lastOscillator, float* mixBuffer, int numSamples);
 
     //==============================================================================
     void paint (juce::Graphics&) override;
     void resized() override;
 
     void toolsMenuSelect();
-    void saveSpectrum();
+    void saveSpectrum(int compressedBits = 0);
     void loadSpectrum();
+    void loadMorphTarget();
     void loadReferenceFile();
+    void analyseRecording();
+    void viewSpectrogram();
+    void convertReferenceToSpectrum();
+    void simplifyKeyFrames();
+    void toggleConstantQ();
+    void zoomReference();
+    void setRefAnalysisMode(FFTSpectrum::AnalysisMode mode);
+    void toggleAutoAlign();
+    void applyRefPitch();
+    void toggleLiveInput();
+    void startLiveInput();
+    void toggleLiveResynthesis();
+    void updateLiveLatency();
+    void updateGovernorLimits();
+    void timerCallback() override; // Quality governor readout
+    void handleAsyncUpdate() override; // Rebuilds the morph tables after composition edits
+    void showRefFrame(const RefAnalysisWorker::Frame& frame);
     void loadMidi();
     //==============================================================================
     bool keyPressed(const juce::KeyPress&, juce::Component*) override;
@@ -49,19 +81,47 @@ public:
 
 
 private:
+    friend class RealtimeCheck; // AddrSoundRtCheck drives the playback modes without the GUI (RtCheckMain.cpp)
+
     //==============================================================================   
     // 1. Audio :
     float level;
+    double sampleRate;
     juce::OwnedArray<WavetableOscillator> oscillators;
     juce::AudioSampleBuffer sineTable;
-    juce::AudioSampleBuffer squareTable;
     const unsigned int tableSize = 128;
+    DistortionStage distortion; // on the summed partials, oversampled
     juce::Reverb reverb;
     juce::Reverb::Parameters reverbParameters;
+    QualityGovernor governor;
+    std::vector<float> partialAmplitudes;
+
+    // Large partial counts are split across worker threads, each mixing into its own buffer:
+    RenderPool renderPool;
+    juce::AudioSampleBuffer workerMixBuffers;
+    const int parallelRenderThreshold = 64; // oscillators; below this the serial path is cheaper (AddrSoundBatch --benchmark-render)
+    struct PartialRenderJob : RenderPool::Job
+    {
+        PartialRenderJob(MainComponent& owner) : owner(owner) {}
+        void render(int worker, int nWorkers) noexcept override;
+        MainComponent& owner;
+        int nOscillators = 0;
+        int numSamples = 0;
+    } partialRenderJob {*this};
+
+    // Opt-in SCHED_FIFO, core pinning and memory locking (see RealtimeSetup.h):
+    RealtimeSetup realtimeSetup;
+    bool audioThreadPromoted = false; // only accessed by the audio thread once running
+    void prepareRealtime();
 
     // 2. Spectrum Data :
     AdditiveSpectrum additiveSpectrum;
     FFTSpectrum refSpectrum;
+    // The composition morphs towards morphTarget by the Morph control (or MIDI CC), from tables
+    // rebuilt whenever either patch is replaced or the composition is edited:
+    AdditiveSpectrum morphTarget;
+    MorphEngine morphEngine;
+    std::vector<float> morphMagnitudes; // audio thread
 
     // 3. GUI Elements:
     SpectrumEditor spectrumEditor;
@@ -70,25 +130,46 @@ private:
     {
     public:
         ToolsButton();
-        enum ItemIDs {SaveID=1, LoadID, MidiID, GainID, VibratoID, DistortionID, ReverbID, LoadRefID};
+        enum ItemIDs {SaveID=1, LoadID, MidiID, GainID, VibratoID, DistortionID, ReverbID, LoadRefID, AnalyseID, SpectrogramID, ConvertRefID, SimplifyID, ConstantQID, ZoomRefID, AutoAlignID, LiveInputID,
+                      LiveResynthID, PitchShiftID, HarmonicSnapID, PartialLimitID, MorphTargetID, MorphID,
+                      OversamplingID, SaveCompressedID, PickRadiusID, MinPartialsID, MaxLoadID, RefPitchID};
     } toolsButton;
 
     juce::Slider refAudioPositionSlider;
+    juce::Label liveLatencyLabel;
+    juce::Label governorLabel;
 
     EffectSettings effectSettings;
 
     // 4. Audio Reference File Playing
-    std::atomic<bool> refPlaying;
-    std::shared_ptr<Spectrum::Peaks> fftPeaks;
-    std::array<std::shared_ptr<Spectrum::Peaks>,8> circularPointerBuffer;
-    int circularPointerBufferIndex;
+    RefAnalysisWorker refAnalysisWorker; // Owns refSpectrum's analysis whilst a reference file is loaded
+    juce::File refFile;
+    bool autoAlignRef = false; // Align the reference display to the composition's harmonics at its detected pitch
+    float detectedRefPitch = 0.0f; // Hz, whilst auto-aligning; only becomes the note when the user applies it
+    std::atomic<bool> refPlaying {false};
+    // Latest reference peaks, from the analysis worker (or loadReferenceFile) to the audio thread.
+    // Sized to the oscillator pool in prepareToPlay.
+    TripleBuffer<Spectrum::PeakFrame> refPeakFrames;
+    void publishRefPeaks(const Spectrum::Peaks& peaks);
+    OscillatorAssigner oscillatorAssigner; // audio thread only, once prepared
+    bool wasPlayingReference = false;
+    // Live input analysed through refSpectrum instead of a file (input channels are only opened for it):
+    LiveInputAnalyser liveInputAnalyser;
+    std::atomic<bool> liveInput {false}; // whether the audio thread pushes input to the analyser
+    // Live resynthesis: the analyser publishes transformed peaks to refPeakFrames, which the audio
+    // thread plays like the reference, measuring how long after capture each frame is heard.
+    std::atomic<bool> liveResynthesis {false};
+    std::atomic<int> liveLatencySamples {0};
+    PartialTransform liveTransform; // analysis thread only, once prepared
+    void publishLivePeaks(const LiveInputAnalyser::Frame& frame);
 
     // 5. MIDI Playback
     juce::MidiFile mFile;
     class MidiTimer : public juce::HighResolutionTimer
     {
     public:
-        MidiTimer(AdditiveSpectrum& additiveSpectrum, TimeSlider& timeSlider, std::atomic<double>* midiControlState);
+        MidiTimer(AdditiveSpectrum& additiveSpectrum, TimeSlider& timeSlider, std::atomic<double>* midiControlState,
+                  std::atomic<double>* morphControlState);
         void hiResTimerCallback() override;
         void play(const juce::MidiMessageSequence* track);
         void scheduleNextNote();
@@ -99,6 +180,8 @@ private:
         int eventIndex;
         double currentTime;
         std::atomic<double>* midiControlState;
+        std::atomic<double>* morphControlState;
+        static constexpr int morphController = 1; // Mod wheel
         AdditiveSpectrum& additiveSpectrum;
         TimeSlider& timeSlider;
     } midiPlayer;
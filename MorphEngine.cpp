@@ -0,0 +1,93 @@
+#include "MorphEngine.h"
+#include "AdditiveSpectrum.h"
+#include "Tracer.h"
+
+void MorphEngine::build(AdditiveSpectrum& from, AdditiveSpectrum& to)
+{
+    ADDRSOUND_TRACE_SCOPE("MorphEngine::build");
+    Tables& built = tables.getWriteBuffer();
+    auto& breakpoints = built.breakpoints;
+    nPartials = built.nPartials = from.getNFreqs();
+    built.duration = from.getDuration();
+    const int nTargetPartials = juce::jmin(nPartials, to.getNFreqs());
+
+    // Breakpoints: both patches' keyframes on a normalised time axis, plus either end
+    breakpoints = {0.0f, 1.0f};
+    juce::Array<float> keyFrameTimes;
+    for (auto* spectrum : {&from, &to})
+    {
+        spectrum->updateKeyFrameTimes(keyFrameTimes);
+        for (float t : keyFrameTimes) breakpoints.push_back(juce::jlimit(0.0f, 1.0f, t / spectrum->getDuration()));
+    }
+    std::sort(breakpoints.begin(), breakpoints.end());
+    const float epsilon = 1.0e-4f;
+    breakpoints.erase(std::unique(breakpoints.begin(), breakpoints.end(), [epsilon] (float a, float b) {return b - a < epsilon;}),
+                      breakpoints.end());
+    if (breakpoints.back() < 1.0f) breakpoints.back() = 1.0f; // a near duplicate of the end was kept instead
+
+    // Both patches at every breakpoint, as from and the difference to:
+    nBreakpoints = (int) breakpoints.size();
+    std::vector<float> values((size_t) (nBreakpoints * nPartials)), differences((size_t) (nBreakpoints * nPartials), 0.0f);
+    std::vector<float> targetValues((size_t) to.getNFreqs());
+    for (int b = 0; b < nBreakpoints; b++)
+    {
+        float* v = &values[(size_t) (b * nPartials)];
+        float* d = &differences[(size_t) (b * nPartials)];
+        from.getMagnitudesAt(breakpoints[(size_t) b] * from.getDuration(), v);
+        to.getMagnitudesAt(breakpoints[(size_t) b] * to.getDuration(), targetValues.data());
+        for (int i = 0; i < nPartials; i++) d[i] = (i < nTargetPartials ? targetValues[(size_t) i] : 0.0f) - v[i];
+    }
+
+    // Each segment's tables, with slopes per unit of normalised time:
+    const int nSegments = nBreakpoints - 1;
+    built.segments.resize((size_t) (nSegments * tablesPerSegment * nPartials));
+    for (int s = 0; s < nSegments; s++)
+    {
+        const float inverseLength = 1.0f / (breakpoints[(size_t) s + 1] - breakpoints[(size_t) s]);
+        float* table = &built.segments[(size_t) (s * tablesPerSegment * nPartials)];
+        const float* v = &values[(size_t) (s * nPartials)];
+        const float* d = &differences[(size_t) (s * nPartials)];
+        for (int i = 0; i < nPartials; i++)
+        {
+            table[i] = v[i];
+            table[nPartials + i] = (v[nPartials + i] - v[i]) * inverseLength;
+            table[2*nPartials + i] = d[i];
+            table[3*nPartials + i] = (d[nPartials + i] - d[i]) * inverseLength;
+        }
+    }
+    tables.publish();
+}
+
+void MorphEngine::clear()
+{
+    Tables& empty = tables.getWriteBuffer();
+    empty.nPartials = nPartials = 0;
+    empty.breakpoints.clear();
+    empty.segments.clear();
+    nBreakpoints = 0;
+    tables.publish();
+}
+
+bool MorphEngine::evaluate(float time, float amount, float* magnitudes, int nMagnitudes) noexcept
+{
+    tables.update();
+    const Tables& latest = tables.getReadBuffer();
+    if (latest.nPartials == 0 || latest.nPartials != nMagnitudes) return false;
+    const auto& breakpoints = latest.breakpoints;
+
+    const float position = juce::jlimit(0.0f, 1.0f, time / latest.duration);
+    const int nSegments = (int) breakpoints.size() - 1;
+    const int segment = juce::jlimit(0, nSegments - 1, (int) (std::upper_bound(breakpoints.begin(), breakpoints.end(), position) - breakpoints.begin()) - 1);
+    const float t = position - breakpoints[(size_t) segment];
+
+    // (from + t*fromSlope) + amount*(difference + t*differenceSlope), in one pass:
+    const float* table = &latest.segments[(size_t) (segment * tablesPerSegment * nMagnitudes)];
+    const float* value = table;
+    const float* slope = table + nMagnitudes;
+    const float* difference = table + 2*nMagnitudes;
+    const float* differenceSlope = table + 3*nMagnitudes;
+    const float amountT = amount * t;
+    for (int i = 0; i < nMagnitudes; i++)
+        magnitudes[i] = value[i] + t * slope[i] + amount * difference[i] + amountT * differenceSlope[i];
+    return true;
+}
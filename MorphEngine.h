@@ -0,0 +1,44 @@
+#pragma once
+
+#include <juce_core/juce_core.h>
+
+#include "TripleBuffer.h"
+
+class AdditiveSpectrum;
+
+// Morphs the magnitudes of one AdditiveSpectrum patch towards another's (timbres on the same
+// harmonics). When built, both patches are resampled onto a common grid of breakpoints (the union
+// of their keyframe times, each scaled to its own duration), and every segment between two
+// breakpoints is stored contiguously as its start values and slopes. The audio thread then
+// evaluates any time and morph amount with a single fused multiply-add pass over the partials.
+class MorphEngine
+{
+public:
+    // Message thread (allocates). from sets the partial count and time scale; partials the target
+    // doesn't have are silent. The tables reach the audio thread through a triple buffer, so they
+    // can be rebuilt whilst it runs, e.g. after every edit of the composition.
+    void build(AdditiveSpectrum& from, AdditiveSpectrum& to);
+    void clear();
+    // Message thread, of the tables last built:
+    bool isReady() const {return nPartials > 0;}
+    int getNumPartials() const {return nPartials;}
+    int getNumBreakpoints() const {return nBreakpoints;}
+
+    // Audio thread: from's magnitudes at its time, morphed by amount (0..1) towards the target's.
+    // Returns false, leaving magnitudes alone, unless the latest tables have nMagnitudes partials.
+    bool evaluate(float time, float amount, float* magnitudes, int nMagnitudes) noexcept;
+
+private:
+    static constexpr int tablesPerSegment = 4; // from, from slope, difference, difference slope
+
+    struct Tables
+    {
+        int nPartials = 0;
+        float duration = 1.0f; // of from
+        std::vector<float> breakpoints; // normalised time, 0 to 1
+        std::vector<float> segments; // tablesPerSegment * nPartials per segment
+    };
+    TripleBuffer<Tables> tables;
+    int nPartials = 0;
+    int nBreakpoints = 0;
+};
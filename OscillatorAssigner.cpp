@@ -0,0 +1,109 @@
+#include "OscillatorAssigner.h"
+#include "Tracer.h"
+
+void OscillatorAssigner::prepare(int nOscillators)
+{
+    frequencies.assign((size_t) nOscillators, 0.0f);
+    amplitudes.assign((size_t) nOscillators, 0.0f);
+    candidates.reserve((size_t) nOscillators);
+    // Frames are allocated to the oscillator count, so that bounds the peaks too:
+    sortedPeaks.resize((size_t) nOscillators);
+    peakClaimed.resize((size_t) nOscillators);
+    matched.resize((size_t) nOscillators);
+    silentOscillators.reserve((size_t) nOscillators);
+    unclaimedPeaks.reserve((size_t) nOscillators);
+    frameAssigned = false;
+}
+
+void OscillatorAssigner::reset() noexcept
+{
+    std::fill(amplitudes.begin(), amplitudes.end(), 0.0f);
+    frameAssigned = false;
+}
+
+// Index into sortedPeaks of the unclaimed peak nearest to frequency within maxRelativeJump, or -1
+int OscillatorAssigner::findUnclaimedPeak(const Spectrum::PeakFrame& frame, int nPeaks, float frequency) const noexcept
+{
+    const float maxJump = maxRelativeJump * frequency;
+    auto firstAbove = std::lower_bound(sortedPeaks.begin(), sortedPeaks.begin() + nPeaks, frequency,
+                                       [&frame] (int peak, float f) {return frame.frequencies[(size_t) peak] < f;});
+    int above = (int) (firstAbove - sortedPeaks.begin());
+    int below = above - 1;
+    auto distance = [&] (int position) {return std::abs(frame.frequencies[(size_t) sortedPeaks[(size_t) position]] - frequency);};
+
+    // Walk outwards past claimed peaks on either side, then take the nearer unclaimed one:
+    while (above < nPeaks && peakClaimed[(size_t) sortedPeaks[(size_t) above]] && distance(above) <= maxJump) above++;
+    while (below >= 0 && peakClaimed[(size_t) sortedPeaks[(size_t) below]] && distance(below) <= maxJump) below--;
+    const bool aboveOk = above < nPeaks && !peakClaimed[(size_t) sortedPeaks[(size_t) above]] && distance(above) <= maxJump;
+    const bool belowOk = below >= 0 && !peakClaimed[(size_t) sortedPeaks[(size_t) below]] && distance(below) <= maxJump;
+    if (aboveOk && belowOk) return distance(above) < distance(below) ? above : below;
+    return aboveOk ? above : belowOk ? below : -1;
+}
+
+void OscillatorAssigner::assign(const Spectrum::PeakFrame& frame) noexcept
+{
+    ADDRSOUND_TRACE_SCOPE("OscillatorAssigner::assign");
+    const int nOscillators = (int) amplitudes.size();
+    const int nPeaks = juce::jmin(frame.nPeaks, (int) sortedPeaks.size());
+    frameAssigned = true;
+
+    for (int peak = 0; peak < nPeaks; peak++) sortedPeaks[(size_t) peak] = peak;
+    std::sort(sortedPeaks.begin(), sortedPeaks.begin() + nPeaks,
+              [&frame] (int a, int b) {return frame.frequencies[(size_t) a] < frame.frequencies[(size_t) b];});
+    std::fill(peakClaimed.begin(), peakClaimed.begin() + nPeaks, (char) 0);
+    std::fill(matched.begin(), matched.end(), (char) 0);
+
+    // Each sounding oscillator's nearest peak:
+    candidates.clear();
+    silentOscillators.clear();
+    for (int oscillator = 0; oscillator < nOscillators; oscillator++)
+    {
+        if (amplitudes[(size_t) oscillator] == 0.0f)
+        {
+            silentOscillators.push_back(oscillator);
+            continue;
+        }
+        const float f = frequencies[(size_t) oscillator];
+        const int position = findUnclaimedPeak(frame, nPeaks, f);
+        if (position >= 0)
+        {
+            const int peak = sortedPeaks[(size_t) position];
+            candidates.push_back({std::abs(frame.frequencies[(size_t) peak] - f), oscillator, peak});
+        }
+    }
+
+    // Closest pairs first (greedy). An oscillator whose nearest peak was taken tries the next nearest:
+    std::sort(candidates.begin(), candidates.end());
+    for (auto& candidate : candidates)
+    {
+        int peak = candidate.peak;
+        if (peakClaimed[(size_t) peak])
+        {
+            const int position = findUnclaimedPeak(frame, nPeaks, frequencies[(size_t) candidate.oscillator]);
+            if (position < 0) continue;
+            peak = sortedPeaks[(size_t) position];
+        }
+        peakClaimed[(size_t) peak] = 1;
+        matched[(size_t) candidate.oscillator] = 1;
+        frequencies[(size_t) candidate.oscillator] = frame.frequencies[(size_t) peak];
+        amplitudes[(size_t) candidate.oscillator] = frame.amplitudes[(size_t) peak];
+    }
+
+    // Oscillators left without a peak fade out at their frequency:
+    for (int oscillator = 0; oscillator < nOscillators; oscillator++)
+        if (!matched[(size_t) oscillator]) amplitudes[(size_t) oscillator] = 0.0f;
+
+    // Births on oscillators that were already silent (the fading ones finish first), loudest peaks first:
+    unclaimedPeaks.clear();
+    for (int peak = 0; peak < nPeaks; peak++)
+        if (!peakClaimed[(size_t) peak] && frame.amplitudes[(size_t) peak] > 0.0f) unclaimedPeaks.push_back(peak);
+    std::sort(unclaimedPeaks.begin(), unclaimedPeaks.end(),
+              [&frame] (int a, int b) {return frame.amplitudes[(size_t) a] > frame.amplitudes[(size_t) b];});
+    const size_t nBirths = juce::jmin(unclaimedPeaks.size(), silentOscillators.size());
+    for (size_t i = 0; i < nBirths; i++)
+    {
+        const int oscillator = silentOscillators[i];
+        frequencies[(size_t) oscillator] = frame.frequencies[(size_t) unclaimedPeaks[i]];
+        amplitudes[(size_t) oscillator] = frame.amplitudes[(size_t) unclaimedPeaks[i]];
+    }
+}
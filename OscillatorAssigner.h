@@ -0,0 +1,44 @@
+#pragma once
+
+#include "Spectrum.h"
+
+// Keeps reference resynthesis continuous. Rather than oscillator i playing the i-th peak of each
+// frame (so every oscillator above a peak that appears or disappears jumps to its neighbour's
+// frequency), each peak of a new frame continues the sounding oscillator closest to it in frequency.
+// Oscillators left without a peak fade out where they are, and new peaks fade in on silent ones.
+// prepare() allocates everything; the other methods are allocation and lock free for the audio thread.
+class OscillatorAssigner
+{
+public:
+    void prepare(int nOscillators);
+
+    // Every oscillator fades out, and the next frame is assigned from scratch
+    void reset() noexcept;
+    bool hasFrame() const noexcept {return frameAssigned;}
+
+    // Matches the peaks of a new frame to the oscillators
+    void assign(const Spectrum::PeakFrame& frame) noexcept;
+
+    // Targets for the oscillator to glide to over the next block. A silent one has no frequency.
+    float getFrequency(int oscillator) const noexcept {return frequencies[(size_t) oscillator];}
+    float getAmplitude(int oscillator) const noexcept {return amplitudes[(size_t) oscillator];}
+
+    float maxRelativeJump = 0.06f; // between frames for a peak to continue an oscillator (about a semitone)
+
+private:
+    int findUnclaimedPeak(const Spectrum::PeakFrame& frame, int nPeaks, float frequency) const noexcept;
+
+    struct Candidate
+    {
+        float distance;
+        int oscillator, peak;
+        bool operator<(const Candidate& other) const noexcept {return distance < other.distance;}
+    };
+
+    std::vector<float> frequencies, amplitudes;
+    std::vector<Candidate> candidates;
+    std::vector<int> sortedPeaks; // peak indices ascending in frequency
+    std::vector<char> peakClaimed, matched;
+    std::vector<int> silentOscillators, unclaimedPeaks;
+    bool frameAssigned = false;
+};
@@ -0,0 +1,208 @@
+#include "PartialTracker.h"
+#include "AdditiveSpectrum.h"
+#include "FFTSpectrum.h"
+#include "Tracer.h"
+
+float PartialTracker::Track::getMeanFrequency() const
+{
+    // Weighted by amplitude, so the quiet attack/release of a partial hardly counts
+    double sum = 0.0, weights = 0.0;
+    for (auto& peak : peaks)
+    {
+        sum += (double) peak.frequency * peak.amplitude;
+        weights += peak.amplitude;
+    }
+    return weights > 0.0 ? (float) (sum / weights) : peaks.front().frequency;
+}
+
+PartialTracker::PartialTracker(const Settings& s)
+    : settings(s) {}
+
+bool PartialTracker::analyse(const juce::File& file, float newNoteFreq)
+{
+    noteFreq = newNoteFreq;
+    tracks.clear();
+    const auto openTicks = juce::Time::getHighResolutionTicks();
+
+    FFTSpectrum probe(512, 512, 2); // Same analysis as the reference spectrum
+    if (!probe.addAudioSource(file)) return false;
+    duration = probe.getDuration();
+    const float windowPeriod = probe.getWindowPeriodSeconds();
+
+    // Frames overlap by half a window, up to maxFrames:
+    const int nFrames = juce::jlimit(2, settings.maxFrames, (int) (duration / (windowPeriod / 2)) + 1);
+    frames.assign((size_t) nFrames, {});
+
+    const auto startTicks = juce::Time::getHighResolutionTicks();
+    openSeconds = juce::Time::highResolutionTicksToSeconds(startTicks - openTicks);
+    const int nThreads = juce::jlimit(1, nFrames, settings.nThreads > 0 ? settings.nThreads : juce::SystemStats::getNumCpus());
+    {
+        juce::ThreadPool pool(nThreads);
+        juce::WaitableEvent done;
+        std::atomic<int> remaining(nThreads);
+        for (int thread = 0; thread < nThreads; thread++)
+        {
+            pool.addJob([this, &file, &done, &remaining, thread, nThreads, nFrames] {
+                analyseFrames(file, nFrames * thread / nThreads, nFrames * (thread + 1) / nThreads);
+                if (--remaining == 0) done.signal();
+            });
+        }
+        done.wait();
+    }
+    const auto linkTicks = juce::Time::getHighResolutionTicks();
+    analysisSeconds = juce::Time::highResolutionTicksToSeconds(linkTicks - startTicks);
+
+    linkTracks();
+    assignHarmonics();
+    linkingSeconds = juce::Time::highResolutionTicksToSeconds(juce::Time::getHighResolutionTicks() - linkTicks);
+    return true;
+}
+
+// Peaks of frames [firstFrame, lastFrame), with their own FFTSpectrum so threads share nothing
+void PartialTracker::analyseFrames(const juce::File& file, int firstFrame, int lastFrame)
+{
+    ADDRSOUND_TRACE_SCOPE("PartialTracker::analyseFrames");
+    FFTSpectrum spectrum(512, 512, 2);
+    if (!spectrum.addAudioSource(file)) return;
+
+    const float binWidth = spectrum.getFrequency(1);
+    const float halfWindow = spectrum.getWindowPeriodSeconds() / 2;
+    const int nBins = spectrum.getNFreqs();
+    const int nFrames = (int) frames.size();
+    Spectrum::Peaks peaks;
+    for (int frame = firstFrame; frame < lastFrame; frame++)
+    {
+        // Centre the window on the keyframe's time:
+        spectrum.setTime(juce::jmax(0.0f, frame * duration / (nFrames - 1) - halfWindow));
+        spectrum.refreshFFT();
+        peaks.indexs.clear();
+        peaks.values.clear();
+        spectrum.calcPeaks(peaks);
+
+        const float scale = spectrum.getNormalisationFactor(); // Back to absolute magnitudes, comparable between frames
+        auto& framePeaks = frames[(size_t) frame];
+        framePeaks.reserve(peaks.indexs.size());
+        for (int index : peaks.indexs)
+        {
+            // Refine each peak with a parabola through the neighbouring bins:
+            const float a = spectrum.getMagnitude(juce::jmax(0, index - 1));
+            const float b = spectrum.getMagnitude(index);
+            const float c = spectrum.getMagnitude(juce::jmin(nBins - 1, index + 1));
+            const float denominator = a - 2.0f*b + c;
+            const float offset = denominator < 0.0f ? juce::jlimit(-0.5f, 0.5f, 0.5f * (a - c) / denominator) : 0.0f;
+            framePeaks.push_back({(index + offset) * binWidth, (b - 0.25f * (a - c) * offset) * scale});
+        }
+    }
+}
+
+void PartialTracker::linkTracks()
+{
+    float loudest = 0.0f;
+    for (auto& framePeaks : frames)
+        for (auto& peak : framePeaks) loudest = juce::jmax(loudest, peak.amplitude);
+    const float birthAmplitude = settings.birthThreshold * loudest;
+
+    struct Candidate
+    {
+        float distance;
+        int track, peak;
+        bool operator<(const Candidate& other) const {return distance < other.distance;}
+    };
+    std::vector<Candidate> candidates;
+    std::vector<int> active, stillActive; // tracks continuing into the current frame
+    std::vector<bool> peakClaimed;
+
+    for (int frame = 0; frame < (int) frames.size(); frame++)
+    {
+        const auto& framePeaks = frames[(size_t) frame];
+        peakClaimed.assign(framePeaks.size(), false);
+
+        // Every peak close enough in frequency to where an active track was in the last frame:
+        candidates.clear();
+        for (int track : active)
+        {
+            const float f = tracks[(size_t) track].peaks.back().frequency;
+            const float maxJump = settings.maxFrequencyJump * f;
+            auto first = std::lower_bound(framePeaks.begin(), framePeaks.end(), f - maxJump,
+                                          [] (const Peak& p, float freq) {return p.frequency < freq;});
+            for (auto p = first; p != framePeaks.end() && p->frequency <= f + maxJump; ++p)
+                candidates.push_back({std::abs(p->frequency - f), track, (int) (p - framePeaks.begin())});
+        }
+
+        // Closest pairs first, each track and peak used once; tracks without a peak die:
+        std::sort(candidates.begin(), candidates.end());
+        stillActive.clear();
+        for (auto& candidate : candidates)
+        {
+            auto& track = tracks[(size_t) candidate.track];
+            const bool continued = track.firstFrame + (int) track.peaks.size() > frame;
+            if (continued || peakClaimed[(size_t) candidate.peak]) continue;
+            track.peaks.push_back(framePeaks[(size_t) candidate.peak]);
+            peakClaimed[(size_t) candidate.peak] = true;
+            stillActive.push_back(candidate.track);
+        }
+
+        // Births from the remaining peaks:
+        for (size_t p = 0; p < framePeaks.size(); p++)
+        {
+            if (peakClaimed[p] || framePeaks[p].amplitude < birthAmplitude) continue;
+            Track track;
+            track.firstFrame = frame;
+            track.peaks.push_back(framePeaks[p]);
+            tracks.push_back(std::move(track));
+            stillActive.push_back((int) tracks.size() - 1);
+        }
+        std::swap(active, stillActive);
+    }
+
+    tracks.erase(std::remove_if(tracks.begin(), tracks.end(),
+                                [this] (const Track& t) {return (int) t.peaks.size() < settings.minTrackFrames;}),
+                 tracks.end());
+}
+
+void PartialTracker::assignHarmonics()
+{
+    if (noteFreq <= 0.0f) return;
+    for (auto& track : tracks)
+    {
+        // AdditiveSpectrum index i plays at noteFreq * (i+1):
+        const float frequency = track.getMeanFrequency();
+        const int harmonic = juce::roundToInt(frequency / noteFreq) - 1;
+        if (harmonic >= 0 && harmonic < settings.nHarmonics
+            && std::abs(frequency - (float) (harmonic + 1) * noteFreq) <= settings.harmonicTolerance * noteFreq)
+            track.harmonic = harmonic;
+    }
+}
+
+void PartialTracker::writeKeyFrames(AdditiveSpectrum& spectrum) const
+{
+    // Several tracks on the same harmonic (e.g. one dying as another is born) take the louder.
+    // Births and deaths fade in/out as keyframes either side of a track are silent.
+    const int nFrames = getNumFrames();
+    const int nHarmonics = settings.nHarmonics;
+    std::vector<float> magnitudes((size_t) (nFrames * nHarmonics), 0.0f);
+    float loudest = 0.0f;
+    for (auto& track : tracks)
+    {
+        if (track.harmonic < 0) continue;
+        for (size_t i = 0; i < track.peaks.size(); i++)
+        {
+            float& magnitude = magnitudes[(size_t) ((track.firstFrame + (int) i) * nHarmonics + track.harmonic)];
+            magnitude = juce::jmax(magnitude, track.peaks[i].amplitude);
+            loudest = juce::jmax(loudest, magnitude);
+        }
+    }
+    if (loudest > 0.0f)
+        juce::FloatVectorOperations::multiply(magnitudes.data(), 1.0f / loudest, (int) magnitudes.size());
+
+    spectrum.setKeyFrames(nHarmonics, noteFreq, juce::jmax(duration, 1.0e-3f), nFrames, magnitudes.data());
+}
+
+juce::String PartialTracker::getReport() const
+{
+    int nHarmonicTracks = 0;
+    for (auto& track : tracks) if (track.harmonic >= 0) nHarmonicTracks++;
+    return juce::String(getNumFrames()) + " frames analysed in " + juce::String(analysisSeconds * 1000.0, 1) + " ms, "
+         + juce::String((int) tracks.size()) + " tracks (" + juce::String(nHarmonicTracks) + " harmonic) linked in "
+         + juce::String(linkingSeconds * 1000.0, 1) + " ms";
+}
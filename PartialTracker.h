@@ -0,0 +1,69 @@
+#pragma once
+
+#include <juce_core/juce_core.h>
+
+class AdditiveSpectrum;
+
+// Turns a recording into AdditiveSpectrum keyframes. Spectral peaks of every analysis frame are
+// linked into sinusoidal partial tracks (McAulay-Quatieri: each track continues with the closest
+// peak in frequency, unmatched peaks are born as new tracks, unmatched tracks die), and each
+// track is assigned to the nearest harmonic of the note frequency.
+// Frames are analysed in parallel, each thread with its own FFTSpectrum on the same file.
+class PartialTracker
+{
+public:
+    struct Settings
+    {
+        int nHarmonics = 30;
+        int maxFrames = 1024; // and thus keyframes
+        float maxFrequencyJump = 0.03f; // between consecutive frames, relative to the frequency
+        float birthThreshold = 0.01f; // minimum amplitude (relative to the loudest peak) to start a track
+        int minTrackFrames = 3; // shorter tracks are discarded as noise
+        float harmonicTolerance = 0.3f; // of the note frequency, for a track to belong to a harmonic
+        int nThreads = 0; // 0: one per core
+    };
+
+    struct Peak
+    {
+        float frequency;
+        float amplitude;
+    };
+
+    struct Track
+    {
+        int firstFrame;
+        std::vector<Peak> peaks; // one per frame from firstFrame
+        int harmonic = -1; // index into the AdditiveSpectrum, -1 if not harmonic
+        float getMeanFrequency() const;
+    };
+
+    PartialTracker(const Settings& settings);
+
+    // Analyses the whole file. Returns false if it can't be read.
+    bool analyse(const juce::File& file, float noteFreq);
+
+    // Replaces spectrum's keyframes with the harmonic tracks (the audio thread must be stopped)
+    void writeKeyFrames(AdditiveSpectrum& spectrum) const;
+
+    int getNumFrames() const {return (int) frames.size();}
+    float getDuration() const {return duration;}
+    const std::vector<Track>& getTracks() const {return tracks;}
+    juce::String getReport() const;
+
+    // Stage timings of the last analyse():
+    double getOpenSeconds() const {return openSeconds;}
+    double getAnalysisSeconds() const {return analysisSeconds;}
+    double getLinkingSeconds() const {return linkingSeconds;}
+
+private:
+    void analyseFrames(const juce::File& file, int firstFrame, int lastFrame);
+    void linkTracks();
+    void assignHarmonics();
+
+    const Settings settings;
+    float noteFreq = 0.0f;
+    float duration = 0.0f;
+    std::vector<std::vector<Peak>> frames; // peaks of each frame, ascending in frequency
+    std::vector<Track> tracks;
+    double openSeconds = 0.0, analysisSeconds = 0.0, linkingSeconds = 0.0;
+};
@@ -0,0 +1,51 @@
+#include "PartialTransform.h"
+
+void PartialTransform::prepare(int capacity, double sampleRate)
+{
+    sortedAmplitudes.resize((size_t) capacity);
+    nyquist = (float) (sampleRate / 2);
+}
+
+void PartialTransform::apply(const Settings& settings, Spectrum::PeakFrame& frame, float fundamental)
+{
+    int nPeaks = juce::jmin(frame.nPeaks, (int) sortedAmplitudes.size());
+
+    if (settings.maxPartials > 0 && nPeaks > settings.maxPartials)
+    {
+        // The quietest kept amplitude, then the louder peaks in their original order:
+        std::copy(frame.amplitudes.begin(), frame.amplitudes.begin() + nPeaks, sortedAmplitudes.begin());
+        auto threshold = sortedAmplitudes.begin() + settings.maxPartials - 1;
+        std::nth_element(sortedAmplitudes.begin(), threshold, sortedAmplitudes.begin() + nPeaks, std::greater<float>());
+        int kept = 0;
+        for (int i = 0; i < nPeaks && kept < settings.maxPartials; i++)
+        {
+            if (frame.amplitudes[(size_t) i] < *threshold) continue;
+            frame.frequencies[(size_t) kept] = frame.frequencies[(size_t) i];
+            frame.amplitudes[(size_t) kept] = frame.amplitudes[(size_t) i];
+            frame.phases[(size_t) kept] = frame.phases[(size_t) i];
+            kept++;
+        }
+        nPeaks = kept;
+    }
+
+    const float ratio = std::exp2(settings.pitchShift / 12.0f);
+    const float snap = fundamental > 0.0f ? juce::jlimit(0.0f, 1.0f, settings.harmonicSnap) : 0.0f;
+    int nAudible = 0;
+    for (int i = 0; i < nPeaks; i++)
+    {
+        float frequency = frame.frequencies[(size_t) i];
+        if (snap > 0.0f)
+        {
+            const float harmonic = juce::jmax(1.0f, std::round(frequency / fundamental));
+            frequency += snap * (harmonic * fundamental - frequency);
+        }
+        frequency *= ratio;
+        if (frequency >= nyquist) continue; // The oscillator would alias it back down, off the harmonics
+
+        frame.frequencies[(size_t) nAudible] = frequency;
+        frame.amplitudes[(size_t) nAudible] = frame.amplitudes[(size_t) i];
+        frame.phases[(size_t) nAudible] = frame.phases[(size_t) i];
+        nAudible++;
+    }
+    frame.nPeaks = nAudible;
+}
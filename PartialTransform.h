@@ -0,0 +1,25 @@
+#pragma once
+
+#include "Spectrum.h"
+
+// Transformations of analysed peaks on their way to resynthesis (live input): only the loudest
+// partials are kept, partials are pulled onto the harmonics of the fundamental, then everything
+// is pitch shifted. Peaks shifted to or past Nyquist are dropped. Runs on the analysis thread,
+// without allocating once prepared.
+class PartialTransform
+{
+public:
+    struct Settings
+    {
+        float pitchShift = 0.0f; // semitones
+        float harmonicSnap = 0.0f; // 0: as analysed, 1: exactly on the harmonics
+        int maxPartials = 0; // the loudest are kept, 0 keeps all
+    };
+
+    void prepare(int capacity, double sampleRate); // of the frames to transform, and of their playback
+    void apply(const Settings& settings, Spectrum::PeakFrame& frame, float fundamental);
+
+private:
+    std::vector<float> sortedAmplitudes;
+    float nyquist = 22050.0f;
+};
@@ -0,0 +1,102 @@
+#include "PitchDetector.h"
+#include "FFTSpectrum.h"
+#include "Tracer.h"
+
+PitchDetector::PitchDetector()
+    : settings() {}
+
+PitchDetector::PitchDetector(const Settings& s)
+    : settings(s) {}
+
+void PitchDetector::prepare(float newSampleRate)
+{
+    sampleRate = newSampleRate;
+    maxLag = juce::jmax(2, (int) std::ceil(sampleRate / settings.minFrequency));
+    minLag = juce::jlimit(1, maxLag - 1, (int) std::floor(sampleRate / settings.maxFrequency));
+    windowSamples = maxLag; // Integrates over at least one period of the lowest note
+    nFFTPoints = juce::nextPowerOfTwo(windowSamples + maxLag); // No circular wrap within maxLag
+
+    energy.resize((size_t) getFrameSamples() + 1);
+    difference.resize((size_t) maxLag + 2);
+    for (auto* spectrum : {&windowSpectrum, &frameSpectrum, &realSpectrum, &imagSpectrum})
+        spectrum->resize((size_t) nFFTPoints);
+    productReal.resize((size_t) nFFTPoints);
+    productImag.resize((size_t) nFFTPoints);
+}
+
+float PitchDetector::detect(const float* frame)
+{
+    ADDRSOUND_TRACE_SCOPE("PitchDetector::detect");
+    confidence = 0.0f;
+    const int W = windowSamples;
+
+    energy[0] = 0.0;
+    for (int i=0; i < getFrameSamples(); i++) energy[(size_t) i + 1] = energy[(size_t) i] + (double) frame[i] * frame[i];
+    if (energy[(size_t) W] < 1.0e-8 * W) return 0.0f; // Silence
+
+    // Cross-correlation r(lag) of the window with the frame: IFFT(conj(FFT(window)) * FFT(frame)).
+    // The inverse of a complex spectrum Y from real FFTs: Re(IFFT(Y)) = (Re FFT(Re Y) + Im FFT(Im Y)) / N
+    FFTSpectrum::FFT(frame, windowSpectrum.data(), nFFTPoints, W);
+    FFTSpectrum::FFT(frame, frameSpectrum.data(), nFFTPoints, getFrameSamples());
+    for (int k=0; k < nFFTPoints; k++)
+    {
+        const auto product = std::conj(windowSpectrum[(size_t) k]) * frameSpectrum[(size_t) k];
+        productReal[(size_t) k] = product.real();
+        productImag[(size_t) k] = product.imag();
+    }
+    FFTSpectrum::FFT(productReal.data(), realSpectrum.data(), nFFTPoints, nFFTPoints);
+    FFTSpectrum::FFT(productImag.data(), imagSpectrum.data(), nFFTPoints, nFFTPoints);
+
+    // Difference d(lag) = e(0) + e(lag) - 2 r(lag), then normalised by its cumulative mean:
+    double runningSum = 0.0;
+    difference[0] = 1.0f;
+    for (int lag=1; lag <= maxLag; lag++)
+    {
+        const double r = (realSpectrum[(size_t) lag].real() + imagSpectrum[(size_t) lag].imag()) / nFFTPoints;
+        const double d = juce::jmax(0.0, energy[(size_t) W] + (energy[(size_t) (lag + W)] - energy[(size_t) lag]) - 2.0 * r);
+        runningSum += d;
+        difference[(size_t) lag] = runningSum > 0.0 ? (float) (d * lag / runningSum) : 1.0f;
+    }
+
+    // First dip below the threshold, followed down to its minimum:
+    int period = -1;
+    for (int lag = minLag; lag < maxLag; lag++)
+    {
+        if (difference[(size_t) lag] < settings.threshold)
+        {
+            while (lag + 1 < maxLag && difference[(size_t) lag + 1] < difference[(size_t) lag]) lag++;
+            period = lag;
+            break;
+        }
+    }
+    if (period < 0) return 0.0f;
+
+    // Parabolic interpolation between lags:
+    const float a = difference[(size_t) period - 1], b = difference[(size_t) period], c = difference[(size_t) period + 1];
+    const float denominator = a - 2.0f*b + c;
+    const float offset = denominator > 0.0f ? juce::jlimit(-0.5f, 0.5f, 0.5f * (a - c) / denominator) : 0.0f;
+    confidence = 1.0f - b;
+    return sampleRate / ((float) period + offset);
+}
+
+float PitchDetector::estimateNoteFrequency(FFTSpectrum& spectrum, int maxFrames)
+{
+    prepare(spectrum.getSignalSampleRate());
+    std::vector<float> frame((size_t) getFrameSamples());
+    std::vector<float> fundamentals;
+
+    const float frameSeconds = (float) getFrameSamples() / sampleRate;
+    const float duration = spectrum.getDuration();
+    const float step = juce::jmax(frameSeconds, duration / (float) maxFrames);
+    for (float time = 0.0f; time + frameSeconds <= duration; time += step)
+    {
+        spectrum.readSignal(time, frame.data(), getFrameSamples());
+        const float fundamental = detect(frame.data());
+        if (fundamental > 0.0f) fundamentals.push_back(fundamental);
+    }
+    if (fundamentals.empty()) return 0.0f;
+
+    auto median = fundamentals.begin() + (std::ptrdiff_t) fundamentals.size() / 2;
+    std::nth_element(fundamentals.begin(), median, fundamentals.end());
+    return *median;
+}
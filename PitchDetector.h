@@ -0,0 +1,48 @@
+#pragma once
+
+#include <complex>
+#include <vector>
+
+#include <juce_core/juce_core.h>
+
+class FFTSpectrum;
+
+// Fundamental frequency estimation with YIN (de Cheveigné & Kawahara 2002): the lag whose
+// cumulative mean normalised difference first dips below a threshold is the period. The
+// difference function comes from a cross-correlation done with FFTs, so a frame costs four
+// FFTs rather than window * maxLag multiplications. Buffers are sized by prepare().
+class PitchDetector
+{
+public:
+    struct Settings
+    {
+        float minFrequency = 40.0f;
+        float maxFrequency = 2000.0f;
+        float threshold = 0.1f; // of the normalised difference; higher accepts noisier frames
+    };
+
+    PitchDetector();
+    PitchDetector(const Settings& settings);
+
+    void prepare(float sampleRate);
+    int getFrameSamples() const {return windowSamples + maxLag;}
+
+    // Fundamental of getFrameSamples() samples, or 0 if unvoiced (no clear period, or silence)
+    float detect(const float* frame);
+    float getConfidence() const {return confidence;} // of the last detection, 1 - normalised difference
+
+    // Median fundamental over up to maxFrames frames spread across the spectrum's source, or 0.
+    // Prepares the detector for the source's signal rate.
+    float estimateNoteFrequency(FFTSpectrum& spectrum, int maxFrames = 64);
+
+private:
+    const Settings settings;
+    float sampleRate = 0.0f;
+    int minLag = 1, maxLag = 1, windowSamples = 1, nFFTPoints = 2;
+    float confidence = 0.0f;
+
+    std::vector<double> energy; // prefix sums of the squared frame
+    std::vector<float> difference; // normalised, per lag
+    std::vector<std::complex<float>> windowSpectrum, frameSpectrum, realSpectrum, imagSpectrum;
+    std::vector<float> productReal, productImag;
+};
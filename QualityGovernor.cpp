@@ -0,0 +1,135 @@
+#include "QualityGovernor.h"
+
+QualityGovernor::QualityGovernor()
+    : maxPartials(0), sampleRate(44100.0),
+      minPartials(8), highLoad(0.7f), lowLoad(0.4f),
+      smoothedLoad(0.0f), partialCap(0), lowLoadBlocks(0), settleBlocks(0), blockStartTicks(0)
+{
+    for (auto& count : loadHistogram) count = 0;
+}
+
+void QualityGovernor::prepare(int nPartials, double newSampleRate)
+{
+    maxPartials = nPartials;
+    sampleRate = newSampleRate;
+    partialCap = nPartials;
+    smoothedLoad = 0.0f;
+    lowLoadBlocks = 0;
+    settleBlocks = 0;
+    for (auto& count : loadHistogram) count = 0;
+
+    order.resize((size_t) nPartials);
+    gains.assign((size_t) nPartials, 1.0f);
+    startGains.assign((size_t) nPartials, 1.0f);
+    gainSteps.assign((size_t) nPartials, 0.0f);
+    fadedOut.assign((size_t) nPartials, 0);
+    silenced.assign((size_t) nPartials, 0);
+}
+
+void QualityGovernor::setLimits(int newMinPartials, float newHighLoad, float newLowLoad)
+{
+    jassert(newLowLoad < newHighLoad);
+    minPartials = juce::jmax(1, newMinPartials);
+    highLoad = newHighLoad;
+    lowLoad = newLowLoad;
+}
+
+void QualityGovernor::beginBlock() noexcept
+{
+    blockStartTicks = juce::Time::getHighResolutionTicks();
+}
+
+void QualityGovernor::updateGains(const float* amplitudes, int nPartials, int numSamples) noexcept
+{
+    nPartials = juce::jmin(nPartials, maxPartials);
+    const int cap = partialCap.load(std::memory_order_relaxed);
+
+    // Rank by current amplitude (loudest first), only needed when some partials must be shed:
+    int* ranked = order.data();
+    for (int i=0; i<nPartials; i++) ranked[i] = i;
+    if (cap < nPartials)
+    {
+        std::nth_element(ranked, ranked + cap, ranked + nPartials,
+                         [amplitudes] (int a, int b) {return amplitudes[a] > amplitudes[b];});
+    }
+
+    // Crossfade towards the target gains instead of switching partials on/off within a block:
+    const float maxDelta = (float) numSamples / (fadeSeconds * (float) sampleRate);
+    for (int rank=0; rank<nPartials; rank++)
+    {
+        const auto i = (size_t) ranked[rank];
+        const bool shed = rank >= cap;
+        const float target = shed ? 0.0f : 1.0f;
+        const float start = gains[i];
+        const bool reachesTarget = std::abs(target - start) <= maxDelta;
+        const float end = reachesTarget ? target : start + juce::jlimit(-maxDelta, maxDelta, target - start);
+        gains[i] = end;
+        startGains[i] = start;
+        gainSteps[i] = (end - start) / (float) numSamples;
+        silenced[i] = shed && fadedOut[i];
+        fadedOut[i] = shed && reachesTarget;
+    }
+}
+
+void QualityGovernor::endBlock(int numSamples) noexcept
+{
+    if (numSamples <= 0 || maxPartials == 0) return;
+
+    const double elapsed = juce::Time::highResolutionTicksToSeconds(juce::Time::getHighResolutionTicks() - blockStartTicks);
+    const float load = (float) (elapsed * sampleRate / numSamples);
+    loadHistogram[(size_t) juce::jlimit(0, nHistogramBuckets - 1, (int) (load * 10.0f))].fetch_add(1, std::memory_order_relaxed);
+
+    // After shedding, wait for the fade to finish and take the load afresh at the new cap, rather
+    // than shedding again on every block while a single spike decays out of the average:
+    if (settleBlocks > 0)
+    {
+        settleBlocks--;
+        smoothedLoad.store(load, std::memory_order_relaxed);
+        return;
+    }
+
+    // React to overload immediately, recover slowly:
+    float smoothed = smoothedLoad.load(std::memory_order_relaxed);
+    smoothed = load > smoothed ? load : 0.95f * smoothed + 0.05f * load;
+    smoothedLoad.store(smoothed, std::memory_order_relaxed);
+
+    int cap = partialCap.load(std::memory_order_relaxed);
+    const int minCap = juce::jmin(minPartials.load(std::memory_order_relaxed), maxPartials);
+    if (smoothed > highLoad.load(std::memory_order_relaxed) && cap > minCap)
+    {
+        cap = juce::jmax(minCap, cap - juce::jmax(1, cap / 5)); // Shed 20%
+        lowLoadBlocks = 0;
+        settleBlocks = 1 + (int) std::ceil(fadeSeconds * sampleRate / numSamples);
+    }
+    else if (smoothed < lowLoad.load(std::memory_order_relaxed) && cap < maxPartials)
+    {
+        // Only restore after headroom has been available for a while, to avoid oscillating:
+        if (++lowLoadBlocks * numSamples >= (int) (restoreHoldSeconds * sampleRate))
+        {
+            cap = juce::jmin(maxPartials, cap + juce::jmax(1, maxPartials / 16));
+            lowLoadBlocks = 0;
+        }
+    }
+    else
+        lowLoadBlocks = 0;
+    partialCap.store(cap, std::memory_order_relaxed);
+}
+
+juce::String QualityGovernor::getHistogramReport() const
+{
+    juce::String report = "Callback load histogram:";
+    for (int bucket = 0; bucket < nHistogramBuckets; bucket++)
+    {
+        report << "\n  " << (bucket < nHistogramBuckets - 1 ? juce::String(bucket * 10) + "-" + juce::String(bucket * 10 + 10) + "%"
+                                                             : juce::String(">= 100%"))
+               << ": " << (int) getHistogramCount(bucket);
+    }
+    return report;
+}
+
+float QualityGovernor::getDegradationLevel() const noexcept
+{
+    const int shedable = maxPartials - juce::jmin(minPartials.load(), maxPartials);
+    if (shedable <= 0) return 0.0f;
+    return (float) (maxPartials - getPartialCap()) / (float) shedable;
+}
@@ -0,0 +1,64 @@
+#pragma once
+
+#include <juce_core/juce_core.h>
+
+// Measures how much of each audio callback's deadline is used and, under CPU pressure, caps the
+// number of rendered partials. The quietest partials are faded out first and faded back in once
+// there is headroom again. All audio thread methods are allocation and lock free.
+class QualityGovernor
+{
+public:
+    QualityGovernor();
+
+    void prepare(int maxPartials, double sampleRate);
+
+    // Limits: never render fewer than minPartials; shed above highLoad and restore below lowLoad
+    // (fractions of the callback deadline).
+    void setLimits(int minPartials, float highLoad, float lowLoad);
+
+    // Audio thread:
+    void beginBlock() noexcept;
+    void updateGains(const float* amplitudes, int nPartials, int numSamples) noexcept;
+    void endBlock(int numSamples) noexcept;
+
+    // Gain ramp for this block: partial gain at sample s is start + s*step.
+    float getStartGain(int partial) const noexcept {return startGains[(size_t) partial];}
+    float getGainStep(int partial) const noexcept {return gainSteps[(size_t) partial];}
+    bool isSilenced(int partial) const noexcept {return silenced[(size_t) partial] != 0;} // Faded out for the whole block
+
+    // Monitoring (any thread):
+    float getLoad() const noexcept {return smoothedLoad.load(std::memory_order_relaxed);}
+    int getPartialCap() const noexcept {return partialCap.load(std::memory_order_relaxed);}
+    float getDegradationLevel() const noexcept; // 0 = all partials rendered, 1 = only minPartials
+
+    // Histogram of raw callback load in 10% buckets, the last bucket counting overruns (>= 100%)
+    static constexpr int nHistogramBuckets = 11;
+    juce::uint32 getHistogramCount(int bucket) const noexcept {return loadHistogram[(size_t) bucket].load(std::memory_order_relaxed);}
+    juce::String getHistogramReport() const;
+
+private:
+    int maxPartials;
+    double sampleRate;
+
+    std::atomic<int> minPartials;
+    std::atomic<float> highLoad;
+    std::atomic<float> lowLoad;
+
+    std::atomic<float> smoothedLoad;
+    std::array<std::atomic<juce::uint32>, nHistogramBuckets> loadHistogram;
+    std::atomic<int> partialCap;
+    int lowLoadBlocks; // consecutive blocks below lowLoad
+    int settleBlocks; // after shedding, blocks until the load is measured again at the new cap
+    juce::int64 blockStartTicks;
+
+    const float fadeSeconds = 0.02f;
+    const float restoreHoldSeconds = 0.5f;
+
+    // Preallocated workspace:
+    std::vector<int> order;
+    std::vector<float> gains;
+    std::vector<float> startGains;
+    std::vector<float> gainSteps;
+    std::vector<juce::uint8> fadedOut; // gain reached 0 by the end of the last block
+    std::vector<juce::uint8> silenced;
+};
@@ -0,0 +1,159 @@
+#include "RealtimeSanitizer.h"
+
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <new>
+
+#if JUCE_LINUX || JUCE_MAC
+ #include <execinfo.h>
+ #include <unistd.h>
+#endif
+#if JUCE_LINUX
+ #include <dlfcn.h>
+ #include <pthread.h>
+#endif
+
+namespace
+{
+    thread_local int realtimeDepth = 0;
+    thread_local bool reporting = false; // the report itself may allocate
+    std::atomic<int> violationCount {0};
+    std::atomic<bool> abortOnViolation {false};
+}
+
+RealtimeSanitizer::ScopedRealtimeContext::ScopedRealtimeContext() noexcept {realtimeDepth++;}
+RealtimeSanitizer::ScopedRealtimeContext::~ScopedRealtimeContext() noexcept {realtimeDepth--;}
+
+bool RealtimeSanitizer::isRealtimeContext() noexcept {return realtimeDepth > 0;}
+int RealtimeSanitizer::getViolationCount() noexcept {return violationCount.load();}
+void RealtimeSanitizer::setAbortOnViolation(bool shouldAbort) noexcept {abortOnViolation = shouldAbort;}
+
+void RealtimeSanitizer::reportViolation(const char* what) noexcept
+{
+    if (realtimeDepth == 0 || reporting) return;
+    reporting = true;
+    violationCount++;
+
+    std::fprintf(stderr, "Real-time violation: %s called from the audio thread\n", what);
+   #if JUCE_LINUX || JUCE_MAC
+    void* frames[48];
+    int nFrames = backtrace(frames, 48);
+    backtrace_symbols_fd(frames + 1, nFrames - 1, STDERR_FILENO);
+   #else
+    std::fputs(juce::SystemStats::getStackBacktrace().toRawUTF8(), stderr);
+   #endif
+    std::fflush(stderr);
+
+    reporting = false;
+    if (abortOnViolation) std::abort();
+}
+
+#if ADDRSOUND_RT_SANITIZER
+
+//==============================================================================
+// Interceptors. Only linked in when the sanitizer is enabled, as they replace the global allocator.
+// On Linux malloc and friends and pthread_mutex_lock are interposed for the whole process. Elsewhere
+// only operator new/delete are replaced: e.g. macOS's two-level namespace binds other libraries'
+// malloc and pthread calls directly to libSystem, so interposing them here would miss those calls.
+
+#if JUCE_LINUX
+// glibc exports its allocator under these names, so malloc and friends can be wrapped directly
+extern "C"
+{
+    void* __libc_malloc(size_t);
+    void* __libc_calloc(size_t, size_t);
+    void* __libc_realloc(void*, size_t);
+    void* __libc_memalign(size_t, size_t);
+    void __libc_free(void*);
+
+    void* malloc(size_t size)                   {RealtimeSanitizer::reportViolation("malloc");  return __libc_malloc(size);}
+    void* calloc(size_t n, size_t size)         {RealtimeSanitizer::reportViolation("calloc");  return __libc_calloc(n, size);}
+    void* realloc(void* p, size_t size)         {RealtimeSanitizer::reportViolation("realloc"); return __libc_realloc(p, size);}
+    void free(void* p)                          {if (p) RealtimeSanitizer::reportViolation("free"); __libc_free(p);}
+    void* aligned_alloc(size_t align, size_t size) {RealtimeSanitizer::reportViolation("aligned_alloc"); return __libc_memalign(align, size);}
+    int posix_memalign(void** p, size_t align, size_t size)
+    {
+        RealtimeSanitizer::reportViolation("posix_memalign");
+        *p = __libc_memalign(align, size);
+        return *p ? 0 : ENOMEM;
+    }
+}
+static void* rawAlloc(size_t size)                  {return __libc_malloc(size ? size : 1);}
+static void* rawAlignedAlloc(size_t size, size_t align) {return __libc_memalign(align, size ? size : 1);}
+static void rawFree(void* p)                        {__libc_free(p);}
+static void rawAlignedFree(void* p)                 {__libc_free(p);}
+#elif JUCE_WINDOWS
+static void* rawAlloc(size_t size)                  {return std::malloc(size ? size : 1);}
+static void* rawAlignedAlloc(size_t size, size_t align) {return _aligned_malloc(size ? size : 1, align);}
+static void rawFree(void* p)                        {std::free(p);}
+static void rawAlignedFree(void* p)                 {_aligned_free(p);}
+#else
+static void* rawAlloc(size_t size)                  {return std::malloc(size ? size : 1);}
+static void* rawAlignedAlloc(size_t size, size_t align)
+{
+    void* p = nullptr;
+    return posix_memalign(&p, align, size ? size : 1) == 0 ? p : nullptr;
+}
+static void rawFree(void* p)                        {std::free(p);}
+static void rawAlignedFree(void* p)                 {std::free(p);}
+#endif
+
+void* operator new(size_t size)
+{
+    RealtimeSanitizer::reportViolation("operator new");
+    if (void* p = rawAlloc(size)) return p;
+    throw std::bad_alloc();
+}
+void* operator new[](size_t size)
+{
+    RealtimeSanitizer::reportViolation("operator new[]");
+    if (void* p = rawAlloc(size)) return p;
+    throw std::bad_alloc();
+}
+void* operator new(size_t size, const std::nothrow_t&) noexcept   {RealtimeSanitizer::reportViolation("operator new"); return rawAlloc(size);}
+void* operator new[](size_t size, const std::nothrow_t&) noexcept {RealtimeSanitizer::reportViolation("operator new[]"); return rawAlloc(size);}
+void* operator new(size_t size, std::align_val_t align)
+{
+    RealtimeSanitizer::reportViolation("operator new");
+    if (void* p = rawAlignedAlloc(size, (size_t) align)) return p;
+    throw std::bad_alloc();
+}
+void* operator new[](size_t size, std::align_val_t align)
+{
+    RealtimeSanitizer::reportViolation("operator new[]");
+    if (void* p = rawAlignedAlloc(size, (size_t) align)) return p;
+    throw std::bad_alloc();
+}
+
+void operator delete(void* p) noexcept                          {if (p) RealtimeSanitizer::reportViolation("operator delete"); rawFree(p);}
+void operator delete[](void* p) noexcept                        {if (p) RealtimeSanitizer::reportViolation("operator delete[]"); rawFree(p);}
+void operator delete(void* p, size_t) noexcept                  {if (p) RealtimeSanitizer::reportViolation("operator delete"); rawFree(p);}
+void operator delete[](void* p, size_t) noexcept                {if (p) RealtimeSanitizer::reportViolation("operator delete[]"); rawFree(p);}
+void operator delete(void* p, const std::nothrow_t&) noexcept   {if (p) RealtimeSanitizer::reportViolation("operator delete"); rawFree(p);}
+void operator delete[](void* p, const std::nothrow_t&) noexcept {if (p) RealtimeSanitizer::reportViolation("operator delete[]"); rawFree(p);}
+void operator delete(void* p, std::align_val_t) noexcept        {if (p) RealtimeSanitizer::reportViolation("operator delete"); rawAlignedFree(p);}
+void operator delete[](void* p, std::align_val_t) noexcept      {if (p) RealtimeSanitizer::reportViolation("operator delete[]"); rawAlignedFree(p);}
+void operator delete(void* p, size_t, std::align_val_t) noexcept   {if (p) RealtimeSanitizer::reportViolation("operator delete"); rawAlignedFree(p);}
+void operator delete[](void* p, size_t, std::align_val_t) noexcept {if (p) RealtimeSanitizer::reportViolation("operator delete[]"); rawAlignedFree(p);}
+
+#if JUCE_LINUX
+// std::mutex, juce::CriticalSection and the lock pool behind std::atomic_load(shared_ptr) all end up here
+extern "C" int pthread_mutex_lock(pthread_mutex_t* mutex)
+{
+    // Constant-initialised, so unlike a static with a dynamic initialiser there is no guard (which could itself lock)
+    using LockFunction = int (*)(pthread_mutex_t*);
+    static std::atomic<LockFunction> realLock {nullptr};
+    LockFunction lock = realLock.load(std::memory_order_relaxed);
+    if (lock == nullptr)
+    {
+        lock = (LockFunction) dlsym(RTLD_NEXT, "pthread_mutex_lock");
+        realLock.store(lock, std::memory_order_relaxed);
+    }
+
+    RealtimeSanitizer::reportViolation("pthread_mutex_lock");
+    return lock(mutex);
+}
+#endif
+
+#endif
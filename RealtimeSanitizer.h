@@ -0,0 +1,37 @@
+#pragma once
+
+#include <juce_core/juce_core.h>
+
+// Debug mode (cmake -DADDRSOUND_RT_SANITIZER=ON) which flags threads whilst they run the audio callback
+// and reports, with a stack trace, any heap allocation/free or mutex lock made from them. malloc/free
+// and mutex locks are only caught on Linux; other platforms only see operator new/delete.
+// AddrSoundRtCheck (RtCheckMain.cpp) runs every playback mode through the callback with it enabled.
+#ifndef ADDRSOUND_RT_SANITIZER
+ #define ADDRSOUND_RT_SANITIZER 0
+#endif
+
+#if ADDRSOUND_RT_SANITIZER
+ #define ADDRSOUND_REALTIME_SCOPE RealtimeSanitizer::ScopedRealtimeContext JUCE_JOIN_MACRO(realtimeScope_, __LINE__)
+#else
+ #define ADDRSOUND_REALTIME_SCOPE
+#endif
+
+class RealtimeSanitizer
+{
+public:
+    // Marks the current thread as real-time for the lifetime of this object (may be nested)
+    class ScopedRealtimeContext
+    {
+    public:
+        ScopedRealtimeContext() noexcept;
+        ~ScopedRealtimeContext() noexcept;
+    };
+
+    static bool isRealtimeContext() noexcept;
+
+    // Prints what happened plus a stack trace to stderr if called from a real-time context
+    static void reportViolation(const char* what) noexcept;
+
+    static int getViolationCount() noexcept;
+    static void setAbortOnViolation(bool shouldAbort) noexcept; // e.g. to stop in a debugger at the first one
+};
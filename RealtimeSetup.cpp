@@ -0,0 +1,126 @@
+#include "RealtimeSetup.h"
+
+#if JUCE_LINUX
+ #include <cerrno>
+ #include <cstring>
+ #include <pthread.h>
+ #include <sched.h>
+ #include <sys/mman.h>
+ #include <sys/resource.h>
+ #include <unistd.h>
+#endif
+
+RealtimeSetup::RealtimeSetup()
+{
+    enabled = juce::SystemStats::getEnvironmentVariable("ADDRSOUND_REALTIME", "0").getIntValue() != 0;
+    priority = juce::SystemStats::getEnvironmentVariable("ADDRSOUND_RT_PRIORITY", "80").getIntValue();
+
+    juce::StringArray coreList;
+    coreList.addTokens(juce::SystemStats::getEnvironmentVariable("ADDRSOUND_RT_CORES", ""), ",", "");
+    coreList.removeEmptyStrings();
+    for (auto& core : coreList) cores.add(core.trim().getIntValue());
+
+   #if ! JUCE_LINUX
+    if (enabled) DBG("ADDRSOUND_REALTIME is only supported on Linux, ignoring");
+    enabled = false;
+   #endif
+}
+
+void RealtimeSetup::promoteCurrentThread(int threadIndex) noexcept
+{
+    if (!enabled) return;
+   #if JUCE_LINUX
+    sched_param param {};
+    param.sched_priority = juce::jlimit(sched_get_priority_min(SCHED_FIFO), sched_get_priority_max(SCHED_FIFO), priority);
+    if (int err = pthread_setschedparam(pthread_self(), SCHED_FIFO, &param))
+        schedulingError = err;
+
+    if (!cores.isEmpty())
+    {
+        cpu_set_t cpuSet;
+        CPU_ZERO(&cpuSet);
+        CPU_SET((size_t) cores.getUnchecked(threadIndex % cores.size()), &cpuSet);
+        if (int err = pthread_setaffinity_np(pthread_self(), sizeof(cpuSet), &cpuSet))
+            affinityError = err;
+    }
+    nThreadsPromoted++;
+   #else
+    juce::ignoreUnused(threadIndex);
+   #endif
+}
+
+void RealtimeSetup::lockRegion(void* data, size_t numBytes)
+{
+    if (!enabled || data == nullptr || numBytes == 0) return;
+   #if JUCE_LINUX
+    if (mlock(data, numBytes) == 0)
+        lockedRegions.push_back({data, numBytes});
+    else
+        memoryLockError = errno;
+   #endif
+    prefault(data, numBytes);
+}
+
+void RealtimeSetup::unlockRegions()
+{
+   #if JUCE_LINUX
+    // Freed blocks normally stay mapped, so this unlocks their pages too, including any shared with
+    // allocations still in use (locks aren't counted). prepareRealtime locks every region again
+    // straight after this, which is what keeps the live ones locked.
+    for (auto& region : lockedRegions) munlock(region.first, region.second);
+   #endif
+    lockedRegions.clear();
+    memoryLockError = 0;
+}
+
+void RealtimeSetup::prefault(void* data, size_t numBytes)
+{
+    if (data == nullptr || numBytes == 0) return;
+
+    // Read and write back one byte per page: writing is what maps untouched anonymous pages
+   #if JUCE_LINUX
+    static const size_t pageSize = (size_t) sysconf(_SC_PAGESIZE);
+   #else
+    const size_t pageSize = 4096; // no larger than any page, so every page is still touched
+   #endif
+    auto* bytes = static_cast<volatile char*>(data);
+    for (size_t i = 0; i < numBytes; i += pageSize) bytes[i] = bytes[i];
+    bytes[numBytes - 1] = bytes[numBytes - 1];
+}
+
+juce::String RealtimeSetup::checkPrivileges() const
+{
+    if (!enabled) return {};
+    juce::StringArray problems;
+   #if JUCE_LINUX
+    const bool isRoot = geteuid() == 0;
+    rlimit limit {};
+    if (!isRoot && getrlimit(RLIMIT_RTPRIO, &limit) == 0 && limit.rlim_cur < (rlim_t) priority)
+        problems.add("RLIMIT_RTPRIO is " + juce::String((juce::int64) limit.rlim_cur) + ", below the requested SCHED_FIFO priority "
+                     + juce::String(priority) + " (add an rtprio entry in /etc/security/limits.conf or grant CAP_SYS_NICE)");
+    if (!isRoot && getrlimit(RLIMIT_MEMLOCK, &limit) == 0 && limit.rlim_cur != RLIM_INFINITY)
+        problems.add("RLIMIT_MEMLOCK is limited to " + juce::String((juce::int64) limit.rlim_cur / 1024) + " KB, so locking the audio data may fail"
+                     " (add a memlock unlimited entry in /etc/security/limits.conf or grant CAP_IPC_LOCK)");
+    for (int core : cores)
+    {
+        if (core < 0 || core >= juce::SystemStats::getNumCpus())
+            problems.add("Core " + juce::String(core) + " in ADDRSOUND_RT_CORES does not exist");
+    }
+   #endif
+    return problems.joinIntoString("\n");
+}
+
+juce::String RealtimeSetup::getStatusReport() const
+{
+    if (!enabled) return {};
+    juce::StringArray problems;
+   #if JUCE_LINUX
+    if (memoryLockError != 0)
+        problems.add("mlock failed: " + juce::String(std::strerror(memoryLockError)));
+    if (int err = schedulingError.load())
+        problems.add("Setting SCHED_FIFO priority " + juce::String(priority) + " failed: " + juce::String(std::strerror(err)));
+    if (int err = affinityError.load())
+        problems.add("Pinning threads to cores failed: " + juce::String(std::strerror(err)));
+   #endif
+    return problems.joinIntoString("\n");
+}
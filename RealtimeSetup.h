@@ -0,0 +1,43 @@
+#pragma once
+
+#include <juce_core/juce_core.h>
+
+// Opt-in real-time configuration for Linux. Enabled with the environment variable ADDRSOUND_REALTIME=1:
+//   ADDRSOUND_RT_PRIORITY  SCHED_FIFO priority for the audio and render worker threads (default 80)
+//   ADDRSOUND_RT_CORES     comma separated cores to pin them to, in order (e.g. "2,3,4"), default unpinned
+// The memory the audio thread reads (wavetable, keyframes, mix buffers) is locked with mlock and
+// prefaulted before the first callback. Only those regions are locked: mlockall(MCL_FUTURE) would
+// also pin every later allocation of the process, e.g. GUI images and analysis buffers.
+class RealtimeSetup
+{
+public:
+    RealtimeSetup();
+
+    bool isEnabled() const noexcept {return enabled;}
+
+    // Called on the thread to promote: 0 for the audio thread, 1.. for render workers.
+    // Only makes syscalls, so it's safe to call from the first audio callback.
+    void promoteCurrentThread(int threadIndex) noexcept;
+
+    // Locks and prefaults a region the audio thread reads. Message thread, whilst the audio thread is stopped.
+    void lockRegion(void* data, size_t numBytes);
+    void unlockRegions(); // before the regions are locked again, e.g. after reallocating them
+    static void prefault(void* data, size_t numBytes); // touch every page so the audio thread never faults
+
+    // Checks in advance whether the process is allowed the requested priority and memory locking
+    juce::String checkPrivileges() const;
+    // Describes everything that failed so far (empty if all succeeded)
+    juce::String getStatusReport() const;
+    int getNumThreadsPromoted() const noexcept {return nThreadsPromoted.load();}
+
+private:
+    bool enabled;
+    int priority;
+    juce::Array<int> cores;
+
+    std::atomic<int> schedulingError {0};
+    std::atomic<int> affinityError {0};
+    std::atomic<int> nThreadsPromoted {0};
+    int memoryLockError = 0;
+    std::vector<std::pair<void*, size_t>> lockedRegions;
+};
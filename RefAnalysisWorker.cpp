@@ -0,0 +1,74 @@
+#include "RefAnalysisWorker.h"
+#include "FFTSpectrum.h"
+#include "Tracer.h"
+
+RefAnalysisWorker::RefAnalysisWorker(FFTSpectrum& s)
+    : juce::Thread("Reference Analysis"), spectrum(s), requestedTime(-1.0f) {}
+
+RefAnalysisWorker::~RefAnalysisWorker()
+{
+    stop();
+}
+
+void RefAnalysisWorker::start()
+{
+    // Preallocate every frame for the current source, so analysis never reallocates them:
+    const auto nFreqs = (size_t) spectrum.getNFreqs();
+    frames.forEachBuffer([nFreqs] (Frame& frame) {
+        frame.magnitudes.resize(nFreqs);
+        frame.peaks.indexs.reserve(nFreqs);
+        frame.peaks.values.reserve(nFreqs);
+    });
+    pitchDetector.prepare(spectrum.getSignalSampleRate());
+    pitchFrame.resize((size_t) pitchDetector.getFrameSamples());
+    requestedTime = -1.0f;
+    startThread();
+}
+
+void RefAnalysisWorker::stop()
+{
+    stopThread(2000);
+    cancelPendingUpdate();
+}
+
+void RefAnalysisWorker::requestAnalysis(float time)
+{
+    requestedTime.store(juce::jmax(0.0f, time)); // Overwrites any request not yet picked up
+    notify();
+}
+
+void RefAnalysisWorker::run()
+{
+    while (! threadShouldExit())
+    {
+        float time = requestedTime.exchange(-1.0f);
+        if (time < 0.0f)
+        {
+            wait(-1); // until notify() or stopThread()
+            continue;
+        }
+
+        ADDRSOUND_TRACE_SCOPE("RefAnalysisWorker::analyse");
+        spectrum.setTime(time);
+        spectrum.refreshFFT();
+
+        Frame& frame = frames.getWriteBuffer();
+        frame.time = time;
+        for (size_t i = 0; i < frame.magnitudes.size(); i++) frame.magnitudes[i] = spectrum.getMagnitude((int) i);
+        frame.peaks.indexs.clear();
+        frame.peaks.values.clear();
+        spectrum.calcPeaks(frame.peaks);
+        spectrum.readSignal(time, pitchFrame.data(), (int) pitchFrame.size());
+        frame.fundamental = pitchDetector.detect(pitchFrame.data());
+
+        if (onFrameAnalysed) onFrameAnalysed(frame);
+        frames.publish();
+        triggerAsyncUpdate(); // Coalesced, so the GUI only handles the latest frame
+    }
+}
+
+void RefAnalysisWorker::handleAsyncUpdate()
+{
+    if (frames.update() && onFrameReady)
+        onFrameReady(frames.getReadBuffer());
+}
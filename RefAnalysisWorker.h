@@ -0,0 +1,49 @@
+#pragma once
+
+#include <juce_events/juce_events.h>
+
+#include "Spectrum.h"
+#include "TripleBuffer.h"
+#include "PitchDetector.h"
+
+class FFTSpectrum;
+
+// Runs reference spectrum analysis (setTime, refreshFFT, calcPeaks, pitch) on a background thread.
+// Requests go through a single-slot mailbox where the latest position wins, so a fast scrub
+// only ever analyses the most recent position. Results reach the message thread lock-free.
+class RefAnalysisWorker : private juce::Thread, private juce::AsyncUpdater
+{
+public:
+    struct Frame
+    {
+        float time = 0.0f;
+        std::vector<float> magnitudes;
+        Spectrum::Peaks peaks;
+        float fundamental = 0.0f; // Hz, 0 if unvoiced
+        juce::int64 inputPosition = 0; // live input only: the input sample at the centre of the window
+    };
+
+    RefAnalysisWorker(FFTSpectrum& spectrum);
+    ~RefAnalysisWorker() override;
+
+    // Message thread. The spectrum must not be touched by anyone else whilst the worker is running.
+    void start();
+    void stop(); // waits for any analysis in progress
+    void requestAnalysis(float time);
+    bool isRunning() const {return isThreadRunning();}
+
+    // Called on the worker thread after every analysis, e.g. to hand peaks to the audio thread
+    std::function<void (const Frame&)> onFrameAnalysed;
+    // Called on the message thread with the most recent frame
+    std::function<void (const Frame&)> onFrameReady;
+
+private:
+    void run() override;
+    void handleAsyncUpdate() override;
+
+    FFTSpectrum& spectrum;
+    std::atomic<float> requestedTime; // negative when empty
+    TripleBuffer<Frame> frames;
+    PitchDetector pitchDetector;
+    std::vector<float> pitchFrame; // signal from the analysed time
+};
@@ -0,0 +1,129 @@
+#include <thread>
+
+#include "RenderPool.h"
+
+#if JUCE_LINUX
+ #include <cerrno>
+ #include <semaphore.h>
+#elif JUCE_MAC
+ #include <dispatch/dispatch.h>
+#elif JUCE_WINDOWS
+ #include <windows.h>
+#endif
+
+RenderPool::RenderPool()
+    : currentJob(nullptr), generation(0), nFinished(0), nParked(0), spinSeconds(0.0) {}
+
+RenderPool::~RenderPool()
+{
+    stop();
+}
+
+void RenderPool::start(int nWorkers, double blockSeconds)
+{
+    spinSeconds = spinFractionOfBlock * blockSeconds;
+    if (getNumWorkers() == juce::jmax(1, nWorkers)) return;
+    stop();
+
+    for (int i=1; i<nWorkers; i++)
+    {
+        auto* worker = new Worker(*this, i);
+        threads.add(worker);
+        worker->startThread(juce::Thread::realtimeAudioPriority);
+    }
+}
+
+void RenderPool::stop()
+{
+    for (auto* worker : threads) worker->signalThreadShouldExit();
+    wakeParkedWorkers();
+    for (auto* worker : threads) worker->stopThread(1000);
+    threads.clear();
+}
+
+void RenderPool::run(Job& job) noexcept
+{
+    const int nWorkers = getNumWorkers();
+
+    nFinished.store(0, std::memory_order_relaxed);
+    currentJob.store(&job, std::memory_order_relaxed);
+    generation.fetch_add(1); // Release the workers, then wake any that have parked since the last block:
+    wakeParkedWorkers();
+
+    job.render(0, nWorkers);
+
+    // Wait for the other workers (they run at real-time priority, so this is short):
+    for (int spins = 0; nFinished.load(std::memory_order_acquire) < nWorkers - 1; spins++)
+    {
+        if (spins > spinsBeforeYield) std::this_thread::yield();
+    }
+}
+
+void RenderPool::wakeParkedWorkers() noexcept
+{
+    for (int n = nParked.exchange(0); n > 0; n--) parking.post();
+}
+
+RenderPool::Worker::Worker(RenderPool& p, int i)
+    : juce::Thread("Render Worker " + juce::String(i)), pool(p), index(i),
+      lastGeneration(p.generation.load()) {}
+
+void RenderPool::Worker::run()
+{
+    if (pool.onWorkerStart) pool.onWorkerStart(index);
+
+    while (! threadShouldExit())
+    {
+        // Spin, then yield, then park until the next block:
+        juce::uint32 current;
+        const auto parkAt = juce::Time::getMillisecondCounterHiRes() + pool.spinSeconds.load(std::memory_order_relaxed) * 1000.0;
+        for (int spins = 0; (current = pool.generation.load(std::memory_order_acquire)) == lastGeneration; spins++)
+        {
+            if (threadShouldExit()) return;
+            if (spins <= pool.spinsBeforeYield) continue;
+            if (juce::Time::getMillisecondCounterHiRes() < parkAt)
+            {
+                std::this_thread::yield();
+                continue;
+            }
+
+            // Counted as parked before the last look at the generation, so that either run() posts
+            // for this worker or the worker sees the new block:
+            pool.nParked.fetch_add(1);
+            if (pool.generation.load() != lastGeneration || threadShouldExit())
+            {
+                // Take the count back, unless run() has already taken it and is posting for it:
+                int n = pool.nParked.load();
+                while (n > 0 && ! pool.nParked.compare_exchange_weak(n, n - 1)) {}
+                if (n > 0) continue;
+            }
+            pool.parking.wait();
+        }
+        lastGeneration = current;
+
+        if (auto* job = pool.currentJob.load(std::memory_order_relaxed))
+            job->render(index, pool.getNumWorkers());
+        pool.nFinished.fetch_add(1, std::memory_order_release);
+    }
+}
+
+//==============================================================================
+#if JUCE_LINUX
+struct RenderPool::Semaphore::Native {sem_t semaphore;};
+RenderPool::Semaphore::Semaphore() : native(new Native) {sem_init(&native->semaphore, 0, 0);}
+RenderPool::Semaphore::~Semaphore() {sem_destroy(&native->semaphore);}
+void RenderPool::Semaphore::post() noexcept {sem_post(&native->semaphore);}
+void RenderPool::Semaphore::wait() noexcept {while (sem_wait(&native->semaphore) != 0 && errno == EINTR) {}}
+#elif JUCE_MAC
+struct RenderPool::Semaphore::Native {dispatch_semaphore_t semaphore = dispatch_semaphore_create(0);};
+RenderPool::Semaphore::Semaphore() : native(new Native) {}
+RenderPool::Semaphore::~Semaphore() {dispatch_release(native->semaphore);}
+void RenderPool::Semaphore::post() noexcept {dispatch_semaphore_signal(native->semaphore);}
+void RenderPool::Semaphore::wait() noexcept {dispatch_semaphore_wait(native->semaphore, DISPATCH_TIME_FOREVER);}
+#elif JUCE_WINDOWS
+struct RenderPool::Semaphore::Native {HANDLE semaphore = CreateSemaphoreW(nullptr, 0, 0x7fffffff, nullptr);};
+RenderPool::Semaphore::Semaphore() : native(new Native) {}
+RenderPool::Semaphore::~Semaphore() {CloseHandle(native->semaphore);}
+void RenderPool::Semaphore::post() noexcept {ReleaseSemaphore(native->semaphore, 1, nullptr);}
+void RenderPool::Semaphore::wait() noexcept {WaitForSingleObject(native->semaphore, INFINITE);}
+#endif
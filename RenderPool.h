@@ -0,0 +1,73 @@
+#pragma once
+
+#include <juce_core/juce_core.h>
+
+// A small pool of pre-spawned worker threads that the audio thread can split a job across.
+// Workers are released and collected with atomic counters (no mutexes or condition variables),
+// and the calling thread takes part as worker 0. Between blocks workers spin for a fraction of the
+// block period, then park on a semaphore, which the audio thread posts without blocking.
+class RenderPool
+{
+public:
+    struct Job
+    {
+        virtual ~Job() = default;
+        virtual void render(int worker, int nWorkers) noexcept = 0;
+    };
+
+    RenderPool();
+    ~RenderPool();
+
+    // nWorkers includes the calling thread, so nWorkers-1 threads are spawned. blockSeconds is the
+    // period between runs, which sizes how long workers spin for the next one before parking.
+    void start(int nWorkers, double blockSeconds);
+    void stop();
+    int getNumWorkers() const noexcept {return threads.size() + 1;}
+
+    // Called on each worker thread (index 1..) when it starts, e.g. to set its scheduling policy
+    std::function<void (int)> onWorkerStart;
+
+    // Runs job on every worker and returns once all of them have finished. Audio thread safe.
+    void run(Job& job) noexcept;
+
+private:
+    class Worker : public juce::Thread
+    {
+    public:
+        Worker(RenderPool& pool, int index);
+        void run() override;
+
+    private:
+        RenderPool& pool;
+        const int index;
+        juce::uint32 lastGeneration; // read before the thread starts, so no job can be missed
+    };
+    juce::OwnedArray<Worker> threads;
+
+    std::atomic<Job*> currentJob;
+    std::atomic<juce::uint32> generation; // incremented to release the workers
+    std::atomic<int> nFinished;
+
+    // Posting is a single non-blocking system call (no locks), so the audio thread can wake workers
+    class Semaphore
+    {
+    public:
+        Semaphore();
+        ~Semaphore();
+        void post() noexcept;
+        void wait() noexcept;
+
+    private:
+        struct Native;
+        std::unique_ptr<Native> native;
+    };
+    Semaphore parking;
+    std::atomic<int> nParked; // workers that will wait on parking, each owed a post
+    void wakeParkedWorkers() noexcept;
+
+    const int spinsBeforeYield = 2000;
+    // Spinning for the whole block would keep real-time priority workers on their cores (where
+    // yielding doesn't let lower priority threads in), so they only spin for the start of it:
+    static constexpr double spinFractionOfBlock = 0.25;
+    std::atomic<double> spinSeconds;
+};
@@ -0,0 +1,194 @@
+#include "MainComponent.h"
+
+// AddrSoundRtCheck: renders blocks of every playback mode through MainComponent's audio callback with
+// the real-time sanitizer built in (see RealtimeSanitizer.h), and fails if any of them allocates,
+// frees or locks on the audio thread.
+//   AddrSoundRtCheck [--blocks=N] [--block=N] [--partials=N] [--abort]
+
+static_assert(ADDRSOUND_RT_SANITIZER, "AddrSoundRtCheck must be built with ADDRSOUND_RT_SANITIZER=1");
+
+// Sets up each mode the way the GUI would, but with the audio device closed so that every block is
+// rendered on this thread, paced like a device whilst the analysis threads feed the reference modes.
+class RealtimeCheck
+{
+public:
+    RealtimeCheck(int blockSize, int nPartials)
+        : blockSize(blockSize), buffer(2, blockSize)
+    {
+        app.shutdownAudio();
+        fillSpectrum(app.additiveSpectrum, nPartials, 0.15f);
+        fillSpectrum(app.morphTarget, nPartials, 0.05f);
+        app.prepareToPlay(blockSize, sampleRate);
+    }
+
+    ~RealtimeCheck()
+    {
+        app.refAnalysisWorker.stop();
+        app.liveInputAnalyser.stop();
+    }
+
+    void checkComposition(int nBlocks)
+    {
+        setControl(EffectSettings::ControlID::Distortion, 0.5); // through the oversampler
+        render("Composition", nBlocks, [this] {keepPlaying();});
+        setControl(EffectSettings::ControlID::Distortion, 0.0);
+    }
+
+    void checkMorph(int nBlocks)
+    {
+        app.morphEngine.build(app.additiveSpectrum, app.morphTarget);
+        setControl(EffectSettings::ControlID::Morph, 0.5);
+        render("Morph", nBlocks, [this] {keepPlaying();});
+        setControl(EffectSettings::ControlID::Morph, 0.0);
+    }
+
+    void checkReference(int nBlocks)
+    {
+        if (!writeReferenceFile() || !app.refSpectrum.addAudioSource(referenceFile.getFile()))
+            juce::ConsoleApplication::fail("Could not write a reference file to " + referenceFile.getFile().getFullPathName());
+        app.refSpectrum.setTime(0.0f);
+        app.refSpectrum.refreshFFT();
+        Spectrum::Peaks peaks;
+        app.refSpectrum.calcPeaks(peaks);
+        app.publishRefPeaks(peaks);
+        app.refAnalysisWorker.start();
+
+        // Scrubbing through the file, as dragging the position slider does:
+        float position = 0.0f;
+        app.refPlaying.store(true, std::memory_order_release);
+        render("Reference", nBlocks, [this, &position] {
+            position = std::fmod(position + (float) blockSize / (float) sampleRate, app.refSpectrum.getDuration());
+            app.refAnalysisWorker.requestAnalysis(position);
+        });
+        app.refPlaying.store(false, std::memory_order_release);
+        app.refAnalysisWorker.stop();
+    }
+
+    void checkLiveResynthesis(int nBlocks)
+    {
+        app.refSpectrum.setLiveSource((float) sampleRate);
+        app.liveInputAnalyser.start();
+        setControl(EffectSettings::ControlID::PitchShift, 3.0);
+        app.liveInput.store(true, std::memory_order_release);
+        app.liveResynthesis.store(true, std::memory_order_release);
+        render("Live resynthesis", nBlocks, nullptr);
+        app.liveResynthesis.store(false, std::memory_order_release);
+        app.liveInput.store(false, std::memory_order_release);
+        app.liveInputAnalyser.stop();
+        setControl(EffectSettings::ControlID::PitchShift, 0.0);
+    }
+
+private:
+    // Decaying harmonics, louder towards the start, over 10 keyframes
+    static void fillSpectrum(AdditiveSpectrum& spectrum, int nPartials, float rolloff)
+    {
+        const int nKeyFrames = 10;
+        std::vector<float> magnitudes((size_t) (nKeyFrames * nPartials));
+        for (int kF = 0; kF < nKeyFrames; kF++)
+            for (int i = 0; i < nPartials; i++)
+                magnitudes[(size_t) (kF * nPartials + i)] = std::exp(-rolloff * (float) i) * (1.0f - 0.08f * (float) kF);
+        spectrum.setKeyFrames(nPartials, 220.0f, 2.0f, nKeyFrames, magnitudes.data());
+    }
+
+    // Two seconds of a 220 Hz tone with a few harmonics
+    bool writeReferenceFile()
+    {
+        std::unique_ptr<juce::OutputStream> stream(referenceFile.getFile().createOutputStream());
+        if (stream == nullptr) return false;
+        juce::WavAudioFormat wav;
+        std::unique_ptr<juce::AudioFormatWriter> writer(wav.createWriterFor(stream.get(), sampleRate, 1, 16, {}, 0));
+        if (writer == nullptr) return false;
+        stream.release(); // owned by the writer
+
+        juce::AudioSampleBuffer tone(1, (int) sampleRate * 2);
+        for (int sample = 0; sample < tone.getNumSamples(); sample++)
+            tone.setSample(0, sample, getTone(sample));
+        return writer->writeFromAudioSampleBuffer(tone, 0, tone.getNumSamples());
+    }
+
+    float getTone(juce::int64 sample) const
+    {
+        const double phase = juce::MathConstants<double>::twoPi * 220.0 * (double) sample / sampleRate;
+        return (float) (0.4 * std::sin(phase) + 0.2 * std::sin(2.0 * phase) + 0.1 * std::sin(3.0 * phase));
+    }
+
+    void keepPlaying()
+    {
+        if (app.additiveSpectrum.getPlayState() == Spectrum::PlayingSound) return;
+        app.additiveSpectrum.play(0.0f);
+    }
+
+    void setControl(EffectSettings::ControlID id, double value)
+    {
+        app.effectSettings.getControlValue(id)->store(value);
+    }
+
+    // Renders nBlocks, with the input tone in the left channel as a device would deliver it
+    void render(const char* mode, int nBlocks, const std::function<void()>& beforeEachBlock)
+    {
+        const int violationsBefore = RealtimeSanitizer::getViolationCount();
+        const int blockMilliseconds = juce::jmax(1, juce::roundToInt(1000.0 * blockSize / sampleRate));
+        float peak = 0.0f;
+        for (int block = 0; block < nBlocks; block++)
+        {
+            if (beforeEachBlock) beforeEachBlock();
+            for (int sample = 0; sample < blockSize; sample++)
+                buffer.setSample(0, sample, getTone(inputPosition + sample));
+            inputPosition += blockSize;
+
+            app.getNextAudioBlock(juce::AudioSourceChannelInfo(&buffer, 0, blockSize));
+            // Read directly, as a device does: the callback writes through pointers taken before it cleared the buffer
+            const auto range = juce::FloatVectorOperations::findMinAndMax(buffer.getReadPointer(0), blockSize);
+            peak = juce::jmax(peak, -range.getStart(), range.getEnd());
+            juce::Thread::sleep(blockMilliseconds);
+        }
+        std::cout << mode << ": " << (RealtimeSanitizer::getViolationCount() - violationsBefore)
+                  << " violations in " << nBlocks << " blocks, peak " << peak << std::endl;
+        // A silent mode would pass without having run its code path:
+        if (peak == 0.0f) juce::ConsoleApplication::fail(juce::String(mode) + " rendered silence");
+    }
+
+    const double sampleRate = 48000.0;
+    const int blockSize;
+    juce::AudioSampleBuffer buffer;
+    juce::int64 inputPosition = 0;
+    juce::TemporaryFile referenceFile {".wav"}; // outlives the app, which may still have it open
+    MainComponent app;
+};
+
+static void checkAudioCallback(const juce::ArgumentList& args)
+{
+    const int nBlocks = args.containsOption("--blocks") ? juce::jmax(1, args.getValueForOption("--blocks").getIntValue()) : 200;
+    const int blockSize = args.containsOption("--block") ? juce::jmax(16, args.getValueForOption("--block").getIntValue()) : 512;
+    const int nPartials = args.containsOption("--partials") ? juce::jmax(1, args.getValueForOption("--partials").getIntValue()) : 96;
+    RealtimeSanitizer::setAbortOnViolation(args.containsOption("--abort"));
+
+    juce::ScopedJuceInitialiser_GUI juce; // MainComponent is a component, though it's never shown
+    {
+        RealtimeCheck check(blockSize, nPartials);
+        check.checkComposition(nBlocks);
+        check.checkMorph(nBlocks);
+        check.checkReference(nBlocks);
+        check.checkLiveResynthesis(nBlocks);
+    }
+
+    const int violations = RealtimeSanitizer::getViolationCount();
+    if (violations > 0) juce::ConsoleApplication::fail(juce::String(violations) + " real-time violations (see the stack traces above)");
+    std::cout << "No real-time violations" << std::endl;
+}
+
+int main(int argc, char* argv[])
+{
+    juce::ConsoleApplication app;
+    app.addHelpCommand("--help|-h", "AddrSoundRtCheck: checks that the audio callback never allocates, frees or locks.", false);
+    app.addDefaultCommand({"--check",
+                           "[--check] [--blocks=N] [--block=N] [--partials=N] [--abort]",
+                           "Renders every playback mode under the real-time sanitizer",
+                           "Renders --blocks blocks (200 by default) of --block samples (512 by default) of the composition, "
+                           "the composition morphing towards a second patch, a reference file being scrubbed, and live input "
+                           "being resynthesised, with --partials oscillators (96 by default, enough for the render workers). "
+                           "Every allocation, free or lock on the audio thread is reported with a stack trace, and the exit "
+                           "code is non-zero if there were any. --abort stops at the first one instead, e.g. under a debugger.",
+                           checkAudioCallback});
+    return app.findAndRunCommand(argc, argv);
+}
@@ -0,0 +1,231 @@
+#include "SpectrogramStore.h"
+
+juce::uint8 SpectrogramStore::toStored(float magnitude)
+{
+    const float decibels = magnitude > 0.0f ? juce::jmax(minDecibels, 20.0f * std::log10(magnitude)) : minDecibels;
+    return (juce::uint8) juce::jlimit(0, 255, juce::roundToInt(255.0f * (1.0f - decibels / minDecibels)));
+}
+
+//==============================================================================
+SpectrogramStore::Writer::Writer(const juce::File& file, int nF, float frameS, float maxF, float fullScale,
+                                 int tFrames, int tFreqs)
+    : stream(file), nFreqs(nF), tileFrames(tFrames), tileFreqs(juce::jmin(tFreqs, nF)),
+      frameSeconds(frameS), maxFrequency(maxF), fullScaleMagnitude(fullScale)
+{
+    // Coarser levels halve the frequencies until one tile spans them, which must land exactly:
+    jassert(nFreqs % tileFreqs == 0 && juce::isPowerOfTwo(nFreqs / tileFreqs) && tileFrames % 2 == 0);
+    if (!stream.openedOk()) return;
+    stream.setPosition(0);
+    stream.truncate();
+
+    // Header; nLevels and the index offset are filled in by finish()
+    stream.writeInt(magic);
+    stream.writeInt(version);
+    stream.writeInt(nFreqs);
+    stream.writeInt(tileFrames);
+    stream.writeInt(tileFreqs);
+    stream.writeInt(0);
+    stream.writeFloat(frameSeconds);
+    stream.writeFloat(maxFrequency);
+    stream.writeFloat(fullScaleMagnitude);
+    stream.writeInt64(0);
+
+    quantised.resize((size_t) nFreqs);
+    pooled.resize((size_t) nFreqs);
+    tileScratch.resize((size_t) (tileFrames * tileFreqs));
+    levels.add(new Level());
+    levels[0]->nFreqs = nFreqs;
+    levels[0]->tileBuffer.resize((size_t) (tileFrames * nFreqs));
+}
+
+SpectrogramStore::Writer::~Writer()
+{
+    if (!finished) finish();
+}
+
+void SpectrogramStore::Writer::addFrame(const float* magnitudes)
+{
+    const float scale = 1.0f / fullScaleMagnitude;
+    for (int i=0; i < nFreqs; i++) quantised[(size_t) i] = toStored(magnitudes[i] * scale);
+    addFrame(0, quantised.data());
+}
+
+void SpectrogramStore::Writer::addFrame(int level, const juce::uint8* values)
+{
+    Level& l = *levels[level];
+    std::copy(values, values + l.nFreqs, l.tileBuffer.begin() + l.framesInTile * l.nFreqs);
+    l.framesInTile++;
+    l.nFrames++;
+
+    if (level + 1 < levels.size())
+    {
+        if (!l.hasPending)
+        {
+            l.pending.assign(values, values + l.nFreqs);
+            l.hasPending = true;
+        }
+        else
+        {
+            pushToParent(level, l.pending.data(), values);
+            l.hasPending = false;
+        }
+    }
+
+    if (l.framesInTile == tileFrames)
+    {
+        flushTile(level);
+        // More than one tile at the top level: start the next level with the frames so far
+        if (level + 1 == levels.size())
+        {
+            addParentLevel();
+            for (int frame=0; frame < tileFrames; frame += 2)
+                pushToParent(level, &l.tileBuffer[(size_t) (frame * l.nFreqs)], &l.tileBuffer[(size_t) ((frame+1) * l.nFreqs)]);
+        }
+        l.framesInTile = 0;
+    }
+}
+
+void SpectrogramStore::Writer::addParentLevel()
+{
+    const Level& child = *levels.getLast();
+    auto* parent = new Level();
+    parent->nFreqs = child.nFreqs > tileFreqs ? child.nFreqs / 2 : child.nFreqs;
+    parent->tileBuffer.resize((size_t) (tileFrames * parent->nFreqs));
+    levels.add(parent);
+}
+
+// Max-pools two frames of level into one frame of the level above
+void SpectrogramStore::Writer::pushToParent(int level, const juce::uint8* first, const juce::uint8* second)
+{
+    const int childFreqs = levels[level]->nFreqs;
+    const int parentFreqs = levels[level + 1]->nFreqs;
+    const int binsPerBin = childFreqs / parentFreqs;
+    for (int bin=0; bin < parentFreqs; bin++)
+    {
+        juce::uint8 value = 0;
+        for (int i = bin*binsPerBin; i < (bin+1)*binsPerBin; i++)
+            value = juce::jmax(value, first[i], second[i]);
+        pooled[(size_t) bin] = value;
+    }
+    addFrame(level + 1, pooled.data());
+}
+
+void SpectrogramStore::Writer::flushTile(int level)
+{
+    Level& l = *levels[level];
+    for (int freqTile=0; freqTile < l.nFreqs / tileFreqs; freqTile++)
+    {
+        std::fill(tileScratch.begin(), tileScratch.end(), (juce::uint8) 0); // A partial last tile is padded
+        for (int frame=0; frame < l.framesInTile; frame++)
+        {
+            auto source = l.tileBuffer.begin() + frame * l.nFreqs + freqTile * tileFreqs;
+            std::copy(source, source + tileFreqs, tileScratch.begin() + frame * tileFreqs);
+        }
+        l.tileOffsets.push_back(stream.getPosition());
+        stream.write(tileScratch.data(), tileScratch.size());
+    }
+}
+
+bool SpectrogramStore::Writer::finish()
+{
+    finished = true;
+    if (!stream.openedOk()) return false;
+
+    // Complete every level from the bottom up (a lone last frame is pooled with itself):
+    for (int level=0; level < levels.size(); level++)
+    {
+        Level& l = *levels[level];
+        if (l.hasPending && level + 1 < levels.size())
+        {
+            pushToParent(level, l.pending.data(), l.pending.data());
+            l.hasPending = false;
+        }
+        if (l.framesInTile > 0)
+        {
+            flushTile(level);
+            l.framesInTile = 0;
+        }
+    }
+
+    const juce::int64 indexOffset = stream.getPosition();
+    for (auto* l : levels)
+    {
+        stream.writeInt(l->nFrames);
+        stream.writeInt(l->nFreqs);
+        stream.writeInt((l->nFrames + tileFrames - 1) / tileFrames);
+        stream.writeInt(l->nFreqs / tileFreqs);
+        for (auto offset : l->tileOffsets) stream.writeInt64(offset);
+    }
+
+    stream.setPosition(5*4);
+    stream.writeInt(levels.size());
+    stream.setPosition(6*4 + 3*4);
+    stream.writeInt64(indexOffset);
+    stream.flush();
+    return stream.getStatus().wasOk();
+}
+
+//==============================================================================
+bool SpectrogramStore::open(const juce::File& file)
+{
+    close();
+    map.reset(new juce::MemoryMappedFile(file, juce::MemoryMappedFile::readOnly));
+    const auto size = map->getSize();
+    if (map->getData() == nullptr || size < headerSize) {close(); return false;}
+
+    juce::MemoryInputStream header(map->getData(), (size_t) headerSize, false);
+    const int fileMagic = header.readInt();
+    const int fileVersion = header.readInt();
+    header.readInt(); // nFreqs (that of level 0)
+    tileFrames = header.readInt();
+    tileFreqs = header.readInt();
+    const int nLevels = header.readInt();
+    frameSeconds = header.readFloat();
+    maxFrequency = header.readFloat();
+    header.readFloat(); // fullScaleMagnitude
+    const juce::int64 indexOffset = header.readInt64();
+    if (fileMagic != magic || fileVersion != version || nLevels <= 0 || indexOffset < headerSize || indexOffset >= (juce::int64) size)
+    {
+        close();
+        return false;
+    }
+
+    const juce::int64 tileBytes = (juce::int64) tileFrames * tileFreqs;
+    juce::MemoryInputStream index(juce::addBytesToPointer(map->getData(), indexOffset), size - (size_t) indexOffset, false);
+    levels.resize((size_t) nLevels);
+    for (auto& level : levels)
+    {
+        level.nFrames = index.readInt();
+        level.nFreqs = index.readInt();
+        level.nTimeTiles = index.readInt();
+        level.nFreqTiles = index.readInt();
+        level.tileOffsets.resize((size_t) (level.nTimeTiles * level.nFreqTiles));
+        for (auto& offset : level.tileOffsets)
+        {
+            offset = index.readInt64();
+            if (offset < headerSize || offset + tileBytes > indexOffset) {close(); return false;}
+        }
+    }
+    return true;
+}
+
+void SpectrogramStore::close()
+{
+    map = nullptr;
+    levels.clear();
+}
+
+int SpectrogramStore::chooseLevel(double secondsPerPixel) const
+{
+    int level = 0;
+    while (level + 1 < getNumLevels() && getFrameSeconds(level + 1) <= secondsPerPixel) level++;
+    return level;
+}
+
+const juce::uint8* SpectrogramStore::getTile(int level, int timeTile, int freqTile) const
+{
+    if (!isOpen() || level < 0 || level >= getNumLevels()) return nullptr;
+    const Level& l = levels[(size_t) level];
+    if (timeTile < 0 || timeTile >= l.nTimeTiles || freqTile < 0 || freqTile >= l.nFreqTiles) return nullptr;
+    return static_cast<const juce::uint8*>(map->getData()) + l.tileOffsets[(size_t) (timeTile * l.nFreqTiles + freqTile)];
+}
@@ -0,0 +1,95 @@
+#pragma once
+
+#include <juce_core/juce_core.h>
+
+// On-disk spectrogram, split into fixed size tiles at several resolutions. Level 0 holds every
+// analysis frame; each level above max-pools pairs of frames (and pairs of bins, until a single
+// tile is tall enough) so any zoom level can be drawn from a handful of tiles.
+// Magnitudes are stored as 8 bit dB values. The file is memory mapped for reading, so only the
+// tiles that are actually looked at are loaded.
+//
+// Layout (little endian): header, tiles (tileFrames x tileFreqs bytes, frame-major, in the order
+// they were completed), then the index: per level nFrames, nFreqs, nTimeTiles, nFreqTiles and the
+// offset of every tile (time tile-major).
+class SpectrogramStore
+{
+public:
+    // Streams frames into a new store file; memory use doesn't grow with the number of frames.
+    class Writer
+    {
+    public:
+        // fullScaleMagnitude is the FFT magnitude stored as 0 dB
+        Writer(const juce::File& file, int nFreqs, float frameSeconds, float maxFrequency, float fullScaleMagnitude,
+               int tileFrames = 256, int tileFreqs = 128);
+        ~Writer();
+
+        bool openedOk() const {return stream.openedOk();}
+        void addFrame(const float* magnitudes);
+        bool finish(); // writes the index; the store can't be read before this
+
+    private:
+        struct Level
+        {
+            int nFreqs;
+            int nFrames = 0;
+            int framesInTile = 0;
+            std::vector<juce::uint8> tileBuffer; // tileFrames frames of nFreqs
+            std::vector<juce::uint8> pending; // first frame of the next pair to pool into the level above
+            bool hasPending = false;
+            std::vector<juce::int64> tileOffsets;
+        };
+
+        void addFrame(int level, const juce::uint8* values);
+        void pushToParent(int level, const juce::uint8* first, const juce::uint8* second);
+        void addParentLevel();
+        void flushTile(int level);
+
+        juce::FileOutputStream stream;
+        const int nFreqs, tileFrames, tileFreqs;
+        const float frameSeconds, maxFrequency, fullScaleMagnitude;
+        juce::OwnedArray<Level> levels;
+        std::vector<juce::uint8> quantised, pooled, tileScratch;
+        bool finished = false;
+    };
+
+    bool open(const juce::File& file);
+    void close();
+    bool isOpen() const {return map != nullptr;}
+
+    int getNumLevels() const {return (int) levels.size();}
+    int getNumFrames(int level) const {return levels[(size_t) level].nFrames;}
+    int getNumFreqs(int level) const {return levels[(size_t) level].nFreqs;}
+    int getNumTimeTiles(int level) const {return levels[(size_t) level].nTimeTiles;}
+    int getNumFreqTiles(int level) const {return levels[(size_t) level].nFreqTiles;}
+    int getTileFrames() const {return tileFrames;}
+    int getTileFreqs() const {return tileFreqs;}
+    float getFrameSeconds(int level) const {return frameSeconds * (float) (1 << level);}
+    float getMaxFrequency() const {return maxFrequency;}
+    float getDuration() const {return levels.empty() ? 0.0f : (float) levels[0].nFrames * frameSeconds;}
+
+    // The coarsest level whose frames are still no longer than secondsPerPixel
+    int chooseLevel(double secondsPerPixel) const;
+
+    // tileFrames x tileFreqs dB values (frame-major), or nullptr outside the spectrogram
+    const juce::uint8* getTile(int level, int timeTile, int freqTile) const;
+
+    static constexpr float minDecibels = -96.0f;
+    static juce::uint8 toStored(float magnitude);
+    static float toDecibels(juce::uint8 stored) {return minDecibels * (1.0f - (float) stored / 255.0f);}
+
+private:
+    static constexpr int magic = 0x47505341; // "ASPG"
+    static constexpr int version = 1;
+    static constexpr int headerSize = 6*4 + 3*4 + 8; // see Writer::Writer
+
+    struct Level
+    {
+        int nFrames, nFreqs, nTimeTiles, nFreqTiles;
+        std::vector<juce::int64> tileOffsets;
+    };
+
+    std::unique_ptr<juce::MemoryMappedFile> map;
+    std::vector<Level> levels;
+    int tileFrames = 0, tileFreqs = 0;
+    float frameSeconds = 0.0f, maxFrequency = 0.0f;
+};
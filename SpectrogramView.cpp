@@ -0,0 +1,118 @@
+#include "SpectrogramView.h"
+#include "Tracer.h"
+
+SpectrogramView::SpectrogramView()
+{
+    // Dark blue (quiet) to yellow (loud):
+    const juce::ColourGradient gradient = [] {
+        juce::ColourGradient g(juce::Colour::fromRGB(10,10,40), 0.0f, 0.0f, juce::Colours::yellow, 1.0f, 0.0f, false);
+        g.addColour(0.5, juce::Colours::red);
+        return g;
+    }();
+    for (size_t i=0; i < colourMap.size(); i++)
+        colourMap[i] = gradient.getColourAtPosition((double) i / 255.0).getPixelARGB();
+}
+
+bool SpectrogramView::open(const juce::File& storeFile)
+{
+    tileImages.clear();
+    if (!store.open(storeFile)) return false;
+    setVisibleRange(0.0, store.getDuration());
+    return true;
+}
+
+void SpectrogramView::setVisibleRange(double startSeconds, double endSeconds)
+{
+    const double duration = juce::jmax(1.0e-3, (double) store.getDuration());
+    const double length = juce::jlimit(1.0e-3, duration, endSeconds - startSeconds);
+    visibleStart = juce::jlimit(0.0, duration - length, startSeconds);
+    visibleEnd = visibleStart + length;
+    repaint();
+}
+
+double SpectrogramView::xToTime(float x) const
+{
+    return visibleStart + (visibleEnd - visibleStart) * x / juce::jmax(1, getWidth());
+}
+
+void SpectrogramView::paint(juce::Graphics& g)
+{
+    ADDRSOUND_TRACE_SCOPE("SpectrogramView::paint");
+    g.fillAll(juce::Colour::fromRGB(50,50,50));
+    if (!store.isOpen() || getWidth() <= 0) return;
+
+    const double secondsPerPixel = (visibleEnd - visibleStart) / getWidth();
+    const int level = store.chooseLevel(secondsPerPixel);
+    const double tileSeconds = store.getTileFrames() * (double) store.getFrameSeconds(level);
+    const int firstTile = (int) (visibleStart / tileSeconds);
+    const int lastTile = juce::jmin(store.getNumTimeTiles(level) - 1, (int) (visibleEnd / tileSeconds));
+    const int nFreqTiles = store.getNumFreqTiles(level);
+    const float tileHeight = (float) getHeight() / (float) nFreqTiles;
+
+    for (int timeTile = firstTile; timeTile <= lastTile; timeTile++)
+    {
+        const float x = (float) ((timeTile * tileSeconds - visibleStart) / secondsPerPixel);
+        const float width = (float) (tileSeconds / secondsPerPixel);
+        for (int freqTile = 0; freqTile < nFreqTiles; freqTile++)
+        {
+            const juce::Image& image = getTileImage(level, timeTile, freqTile);
+            if (image.isNull()) continue;
+            const float y = (float) getHeight() - (float) (freqTile + 1) * tileHeight; // Low frequencies at the bottom
+            g.drawImage(image, juce::Rectangle<float>(x, y, width, tileHeight), juce::RectanglePlacement::stretchToFit);
+        }
+    }
+
+    g.setColour(juce::Colours::white);
+    g.setFont(12.0f);
+    g.drawText(juce::String(visibleStart, 2) + " s", getLocalBounds().reduced(4), juce::Justification::bottomLeft);
+    g.drawText(juce::String(visibleEnd, 2) + " s", getLocalBounds().reduced(4), juce::Justification::bottomRight);
+    g.drawText(juce::String(juce::roundToInt(store.getMaxFrequency())) + " Hz", getLocalBounds().reduced(4), juce::Justification::topLeft);
+}
+
+const juce::Image& SpectrogramView::getTileImage(int level, int timeTile, int freqTile)
+{
+    const juce::int64 key = ((juce::int64) level << 48) | ((juce::int64) timeTile << 16) | freqTile;
+    auto cached = tileImages.find(key);
+    if (cached != tileImages.end()) return cached->second;
+
+    const juce::uint8* tile = store.getTile(level, timeTile, freqTile);
+    if (tile == nullptr) return emptyImage;
+
+    if (tileImages.size() >= maxCachedTiles) tileImages.clear();
+
+    const int nFrames = store.getTileFrames();
+    const int nFreqs = store.getTileFreqs();
+    juce::Image image(juce::Image::ARGB, nFrames, nFreqs, false);
+    {
+        juce::Image::BitmapData pixels(image, juce::Image::BitmapData::writeOnly);
+        for (int frame=0; frame < nFrames; frame++)
+            for (int bin=0; bin < nFreqs; bin++)
+                pixels.setPixelColour(frame, nFreqs - 1 - bin, juce::Colour(colourMap[tile[frame * nFreqs + bin]]));
+    }
+    return tileImages[key] = image;
+}
+
+void SpectrogramView::mouseDown(const juce::MouseEvent& event)
+{
+    dragStartTime = xToTime((float) event.x);
+}
+
+void SpectrogramView::mouseDrag(const juce::MouseEvent& event)
+{
+    // Keep the time under the pointer where it was grabbed:
+    const double length = visibleEnd - visibleStart;
+    const double start = dragStartTime - length * event.x / juce::jmax(1, getWidth());
+    setVisibleRange(start, start + length);
+}
+
+void SpectrogramView::mouseDoubleClick(const juce::MouseEvent&)
+{
+    setVisibleRange(0.0, store.getDuration());
+}
+
+void SpectrogramView::mouseWheelMove(const juce::MouseEvent& event, const juce::MouseWheelDetails& wheel)
+{
+    const double pivot = xToTime((float) event.x);
+    const double zoom = std::pow(0.5, (double) wheel.deltaY * 4.0);
+    setVisibleRange(pivot - (pivot - visibleStart) * zoom, pivot + (visibleEnd - pivot) * zoom);
+}
@@ -0,0 +1,38 @@
+#pragma once
+
+#include <map>
+
+#include <juce_gui_extra/juce_gui_extra.h>
+
+#include "SpectrogramStore.h"
+
+// Zoomable, scrollable view of a SpectrogramStore. Only the tiles of the level that matches the
+// current zoom and that intersect the visible time range are touched.
+// Mouse wheel zooms around the pointer, dragging pans, double click shows the whole file.
+class SpectrogramView : public juce::Component
+{
+public:
+    SpectrogramView();
+
+    bool open(const juce::File& storeFile);
+    void setVisibleRange(double startSeconds, double endSeconds);
+
+    void paint(juce::Graphics& g) override;
+    void mouseDown(const juce::MouseEvent& event) override;
+    void mouseDrag(const juce::MouseEvent& event) override;
+    void mouseDoubleClick(const juce::MouseEvent& event) override;
+    void mouseWheelMove(const juce::MouseEvent& event, const juce::MouseWheelDetails& wheel) override;
+
+private:
+    const juce::Image& getTileImage(int level, int timeTile, int freqTile);
+    double xToTime(float x) const;
+
+    SpectrogramStore store;
+    double visibleStart = 0.0, visibleEnd = 1.0;
+    double dragStartTime = 0.0;
+
+    std::array<juce::PixelARGB, 256> colourMap;
+    std::map<juce::int64, juce::Image> tileImages; // Rendered tiles, dropped when too many are cached
+    const size_t maxCachedTiles = 128;
+    const juce::Image emptyImage;
+};
@@ -2,14 +2,39 @@
 
 Spectrum::Spectrum(int nFreqs, float duration)
         : nFreqs(nFreqs), duration(duration), time(0.0f),
-          iterFreqIndex(0), iterMagIndex(0) {}
+          iterFreqIndex(0), iterMagIndex(0), playback(Stopped) {}
 
 
 int Spectrum::getNFreqs() {return nFreqs;}
 float Spectrum::getTime() {return time;}
 float Spectrum::getDuration() {return duration;}
-Spectrum::PlayState Spectrum::getPlayState() {return playState;}
-void Spectrum::setPlayState(Spectrum::PlayState pS) {playState = pS;}
+Spectrum::PlayState Spectrum::getPlayState() {return getState(playback);}
+
+void Spectrum::setPlayState(Spectrum::PlayState pS)
+{
+    auto word = playback.load();
+    while (!playback.compare_exchange_weak(word, withState(word, pS))) {}
+}
+
+void Spectrum::play(float startTime)
+{
+    time = startTime;
+    auto word = playback.load();
+    while (!playback.compare_exchange_weak(word, withState(word + generationStep, PlayingSound))) {}
+}
+
+bool Spectrum::changePlayState(PlayState from, PlayState to)
+{
+    auto word = playback.load();
+    while (getState(word) == from)
+        if (playback.compare_exchange_weak(word, withState(word, to))) return true;
+    return false;
+}
+
+void Spectrum::setMagnitudes(int firstIndex, const float* mags, int n)
+{
+    for (int i=0; i<n; i++) setMagnitude(firstIndex + i, mags[i]);
+}
 
 void Spectrum::setTime(float t)
 {
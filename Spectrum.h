@@ -1,6 +1,6 @@
 #pragma once
 
-#include <juce_gui_extra/juce_gui_extra.h>
+#include <juce_core/juce_core.h>
 
 class Spectrum
 {
@@ -11,6 +11,7 @@ public:
     int getNFreqs();
     virtual float getMagnitude(int fIndex) = 0;
     virtual void setMagnitude(int /*fIndex*/, float /*mag*/) {}
+    virtual void setMagnitudes(int firstIndex, const float* mags, int n); // Batched setMagnitude
 
     virtual float nextFrequency();
     virtual float nextMagnitude();
@@ -23,6 +24,7 @@ public:
     enum PlayState {EditingSpectrum, PlayingSound, Stopped};
     PlayState getPlayState();
     void setPlayState(PlayState pS);
+    void play(float startTime); // Any thread: (re)starts playback, superseding a play in progress
 
     struct Peaks
     {
@@ -30,14 +32,41 @@ public:
         std::vector<float> values;
     };
 
+    // Peaks resolved to oscillator parameters. The capacity is fixed by allocate() so that a frame
+    // can be refilled (and read by the audio thread) without ever touching the allocator.
+    struct PeakFrame
+    {
+        void allocate(int newCapacity)
+        {
+            frequencies.assign((size_t) newCapacity, 0.0f);
+            amplitudes.assign((size_t) newCapacity, 0.0f);
+            phases.assign((size_t) newCapacity, 0.0f);
+            nPeaks = 0;
+        }
+        int getCapacity() const noexcept {return (int) frequencies.size();}
+
+        int nPeaks = 0;
+        std::vector<float> frequencies;
+        std::vector<float> amplitudes;
+        std::vector<float> phases; // radians, at the start of the analysis window
+        juce::int64 inputPosition = 0; // live input only: the input sample at the centre of the analysed window
+    };
+
 protected:
 
     int nFreqs;
     float duration; // in seconds
-    float time;
+    std::atomic<float> time; // Advanced by the audio thread whilst playing, read by the GUI
+
 
     int iterFreqIndex;
     int iterMagIndex;
 
-    PlayState playState;
+    // The PlayState in the low bits and a generation that play() increments in the rest, so that
+    // the audio thread stopping at the end of an earlier play can't cancel a restart:
+    std::atomic<juce::uint32> playback;
+    static constexpr juce::uint32 stateMask = 3, generationStep = 4;
+    static PlayState getState(juce::uint32 word) {return (PlayState) (word & stateMask);}
+    static juce::uint32 withState(juce::uint32 word, PlayState pS) {return (word & ~stateMask) | (juce::uint32) pS;}
+    bool changePlayState(PlayState from, PlayState to); // Returns false, leaving it, if the state isn't from
 };
\ No newline at end of file
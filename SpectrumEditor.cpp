@@ -3,6 +3,7 @@
 #include "SpectrumEditor.h"
 #include "AdditiveSpectrum.h"
 #include "FFTSpectrum.h"
+#include "Tracer.h"
 
 SpectrumEditor::SpectrumEditor(AdditiveSpectrum& spectrum, FFTSpectrum& refSpectrum)
     : spectrum(spectrum),
@@ -16,6 +17,8 @@ SpectrumEditor::SpectrumEditor(AdditiveSpectrum& spectrum, FFTSpectrum& refSpect
 
 void SpectrumEditor::paint (juce::Graphics& g)  
 {
+    ADDRSOUND_TRACE_SCOPE("SpectrumEditor::paint");
+
     g.fillAll(juce::Colour::fromRGB(50,50,50));
 
     const juce::Point<float> bottomLeft(0,(float) getHeight() - bottomPadding);
@@ -25,44 +28,27 @@ void SpectrumEditor::paint (juce::Graphics& g)
     // Reference Spectrum in background, so first:
     if(!refSpectrumPoints.isEmpty())
     {
-        g.setColour(juce::Colours::darkgrey);
-        juce::Path refSpectrumPath;
-        refSpectrumPath.startNewSubPath(bottomLeft);
-        for (auto i=0; i < refSpectrumPoints.size(); i++)
-        {
-            if (refSpectrumPoints[i] == nullptr) continue;
-            
-            updateDisplayCoords(refSpectrumPoints[i]);
-            juce::Point<float> coords = refSpectrumPoints[i]->displayCoords;
-            coords.x *= refDisplayScale; // Scale this coordinate
-            coords.x += refDisplayOffset; // Offset this coordinate
-            refSpectrumPath.lineTo(coords);
-            if(refSpectrumPoints[i]->marked) // Mark frequency points
-            {
-                const float circleRadius = boundaryRadius;
-                g.fillEllipse(coords.x - circleRadius/2, coords.y - circleRadius/2, circleRadius, circleRadius);
-                g.drawText(juce::String(juce::roundToInt<float>(refSpectrumPoints[i]->getFrequency())), (int)coords.x - 10, (int)coords.y - 20, 20, 20, juce::Justification::centred);
-            }
-        }
-        refSpectrumPath.lineTo(bottomRight);
-        refSpectrumPath.closeSubPath();
-        g.strokePath (refSpectrumPath, juce::PathStrokeType (0.5f));
-
-        g.drawText(juce::String(refSpectrum.getFrequency(0))+" Hz", 0, getHeight()-50, 30, 20, juce::Justification::centred);
-        g.drawText(juce::String(refSpectrum.getFrequency(refSpectrum.getNFreqs()))+" Hz", (int)bottomRight.x-70, getHeight()-50, 80, 20, juce::Justification::centred);
+        if (!refSpectrumImageValid) renderRefSpectrumImage();
+        g.drawImageAt(refSpectrumImage, 0, 0);
     }
 
-    // Additive Spectrum in foreground:
+    // Additive Spectrum in foreground (only the points within the area being repainted):
+    const juce::Rectangle<int> clip = g.getClipBounds();
+    const float clipLeft = (float) clip.getX() - pointStripHalfWidth;
+    const float clipRight = (float) clip.getRight() + pointStripHalfWidth;
     g.setColour(juce::Colours::red);
     
     juce::Path spectrumPath;
     spectrumPath.startNewSubPath(bottomLeft);
-    for (auto i=0; i < spectrumPoints.size(); i++)
+    const int firstVisible = juce::jmax(0, xToIndex(clipLeft) - 1);
+    const int lastVisible = juce::jmin(spectrumPoints.size() - 1, xToIndex(clipRight) + 1);
+    for (auto i=firstVisible; i <= lastVisible; i++)
     {
         if (spectrumPoints[i] == nullptr) continue;
-        // Draw path
-        updateDisplayCoords(spectrumPoints[i]);
         juce::Point<float>& coords = spectrumPoints[i]->displayCoords;
+        if (coords.x < clipLeft || coords.x > clipRight) continue;
+
+        // Draw path
         juce::Point<float> bottom(coords);
         bottom.y = getHeight() - bottomPadding;
         spectrumPath.lineTo(bottom);
@@ -87,6 +73,86 @@ void SpectrumEditor::paint (juce::Graphics& g)
     g.strokePath (spectrumPath, juce::PathStrokeType (1.0f));
 }
 
+void SpectrumEditor::resized()
+{
+    updateAllDisplayCoords(spectrumPoints);
+    updateAllDisplayCoords(refSpectrumPoints);
+    invalidateRefSpectrum();
+}
+
+void SpectrumEditor::renderRefSpectrumImage()
+{
+    const int width = getWidth();
+    const int height = getHeight();
+    if (width <= 0 || height <= 0) return;
+
+    if (refSpectrumImage.getWidth() != width || refSpectrumImage.getHeight() != height)
+        refSpectrumImage = juce::Image(juce::Image::ARGB, width, height, true);
+    else
+        refSpectrumImage.clear(refSpectrumImage.getBounds());
+
+    juce::Graphics g(refSpectrumImage);
+    g.setFont(9.0f);
+    g.setColour(juce::Colours::darkgrey);
+
+    const float baseline = (float) height - bottomPadding;
+
+    // Decimate to the min/max of the points falling in each pixel column, so large FFT sizes
+    // cost one path vertex pair per column rather than one vertex per bin:
+    refColumnTop.assign((size_t) width, baseline + 1.0f);
+    refColumnBottom.assign((size_t) width, -1.0f);
+    for (auto i=0; i < refSpectrumPoints.size(); i++)
+    {
+        auto* point = refSpectrumPoints.getUnchecked(i);
+        juce::Point<float> coords = point->displayCoords;
+        coords.x *= refDisplayScale; // Scale this coordinate
+        coords.x += refDisplayOffset; // Offset this coordinate
+
+        int column = (int) coords.x;
+        if (column < 0 || column >= width) continue;
+        refColumnTop[(size_t) column] = juce::jmin(refColumnTop[(size_t) column], coords.y);
+        refColumnBottom[(size_t) column] = juce::jmax(refColumnBottom[(size_t) column], coords.y);
+
+        if(point->marked) // Mark frequency points
+        {
+            const float circleRadius = boundaryRadius;
+            g.fillEllipse(coords.x - circleRadius/2, coords.y - circleRadius/2, circleRadius, circleRadius);
+            g.drawText(juce::String(juce::roundToInt<float>(point->getFrequency())), (int)coords.x - 10, (int)coords.y - 20, 20, 20, juce::Justification::centred);
+        }
+    }
+
+    juce::Path refSpectrumPath;
+    refSpectrumPath.startNewSubPath(0.0f, baseline);
+    for (auto column=0; column < width; column++)
+    {
+        if (refColumnBottom[(size_t) column] < 0.0f) continue; // no points in this column
+        refSpectrumPath.lineTo((float) column, refColumnTop[(size_t) column]);
+        if (refColumnBottom[(size_t) column] > refColumnTop[(size_t) column])
+            refSpectrumPath.lineTo((float) column, refColumnBottom[(size_t) column]);
+    }
+    refSpectrumPath.lineTo((float) width, baseline);
+    refSpectrumPath.closeSubPath();
+    g.strokePath (refSpectrumPath, juce::PathStrokeType (0.5f));
+
+    g.drawText(juce::String(refSpectrum.getFrequency(0))+" Hz", 0, height-50, 30, 20, juce::Justification::centred);
+    g.drawText(juce::String(refSpectrum.getFrequency(refSpectrum.getNFreqs()))+" Hz", width-70, height-50, 80, 20, juce::Justification::centred);
+
+    refSpectrumImageValid = true;
+}
+
+void SpectrumEditor::invalidateRefSpectrum()
+{
+    refSpectrumImageValid = false;
+}
+
+void SpectrumEditor::repaintPoint(SpectrumPoint* point)
+{
+    if (point == nullptr) return;
+    int left = (int) std::floor(point->displayCoords.x - pointStripHalfWidth);
+    int right = (int) std::ceil(point->displayCoords.x + pointStripHalfWidth);
+    repaint(left, 0, right - left, getHeight());
+}
+
 
 
 
@@ -96,39 +162,40 @@ void SpectrumEditor::mouseDrag (const juce::MouseEvent& event)
 {
 
     const juce::ModifierKeys& modifierKeys = event.mods;
-    if (modifierKeys.isLeftButtonDown()) // Change magnitude of additive spectra points
+    if (modifierKeys.isLeftButtonDown() && modifierKeys.isShiftDown()) // Brush over a range of additive spectra points
+    {
+        brushPoints(event.position);
+    }
+    else if (modifierKeys.isLeftButtonDown()) // Change magnitude of additive spectra points
     {
         // Determine if a point has been selected
-        
-        for (auto i = 0; i < spectrumPoints.size(); i++)
+        if (pointSelected == nullptr)
         {
-
-            juce::Point<float>& pointPosition = spectrumPoints[i]->displayCoords;
-            if (inBoundary(pointPosition, event.position))
+            pointSelected = pointAt(event.position);
+            if (pointSelected != nullptr)
             {
-                // Mouse is close to peak i
-                if (pointSelected) pointSelected->selected = false;
-                pointSelected = spectrumPoints[i];
                 pointSelected->selected = true;
                 pointSelected->marked = true;
-                
-                juce::String debugMsg = "Selected point #" + juce::String((int) i);
+
+                juce::String debugMsg = "Selected point #" + juce::String(pointSelected->index);
                 DBG(debugMsg);
-                break;
             }
         }
 
         if (pointSelected != nullptr)  // point selected
         {
             float mag = coordsToMagnitude(event.position);
+            repaintPoint(pointSelected); // old position
             pointSelected->updateMagnitude(mag);
-            repaint();
+            updateDisplayCoords(pointSelected);
+            repaintPoint(pointSelected);
         }
     }
     else if (modifierKeys.isRightButtonDown()) // Right drag offsets reference spectrum
     {
         float deltaX = (float) event.getDistanceFromDragStartX();
         offsetRefSpectrum(deltaX);
+        invalidateRefSpectrum();
         repaint();
     }
 }
@@ -139,7 +206,12 @@ void SpectrumEditor::mouseUp (const juce::MouseEvent& event)
     if (modifierKeys.isLeftButtonDown())
     {
         if (pointSelected != nullptr)
+        {
             pointSelected->selected = false;
+            repaintPoint(pointSelected);
+            pointSelected = nullptr;
+        }
+        brushing = false;
     }
     else if (modifierKeys.isRightButtonDown()) // Right click clears the spectrum
     {
@@ -148,6 +220,47 @@ void SpectrumEditor::mouseUp (const juce::MouseEvent& event)
     }
 }
 
+void SpectrumEditor::brushPoints(const juce::Point<float>& position)
+{
+    if (spectrumPoints.isEmpty() || getWidth() <= 0) return;
+    if (!brushing)
+    {
+        lastBrushPosition = position;
+        brushing = true;
+    }
+
+    juce::Point<float> from = lastBrushPosition;
+    juce::Point<float> to = position;
+    if (from.x > to.x) std::swap(from, to);
+    lastBrushPosition = position;
+
+    const int lastIndex = spectrumPoints.size() - 1;
+    int first = xToIndex(from.x);
+    int last = xToIndex(to.x);
+    if (last < 0 || first > lastIndex) return; // swept range is outside the spectrum
+    first = juce::jlimit(0, lastIndex, first);
+    last = juce::jlimit(0, lastIndex, last);
+
+    // Magnitudes follow the straight line between the previous and current drag positions:
+    const int count = last - first + 1;
+    brushMagnitudes.resize((size_t) count);
+    for (int i=0; i<count; i++)
+    {
+        SpectrumPoint* point = spectrumPoints.getUnchecked(first + i);
+        float x = point->displayCoords.x;
+        float alpha = (to.x > from.x) ? juce::jlimit(0.0f, 1.0f, (x - from.x) / (to.x - from.x)) : 1.0f;
+        float y = from.y + alpha * (to.y - from.y);
+        point->updateMagnitude(coordsToMagnitude({x, y}), false);
+        updateDisplayCoords(point);
+        brushMagnitudes[(size_t) i] = point->magnitude;
+    }
+    spectrum.setMagnitudes(first, brushMagnitudes.data(), count); // One batched update
+
+    int left = (int) std::floor(spectrumPoints.getUnchecked(first)->displayCoords.x - pointStripHalfWidth);
+    int right = (int) std::ceil(spectrumPoints.getUnchecked(last)->displayCoords.x + pointStripHalfWidth);
+    repaint(left, 0, right - left, getHeight());
+}
+
 void SpectrumEditor::mouseWheelMove(const juce::MouseEvent& /*event*/, const juce::MouseWheelDetails& wheel)
 {
     int dir = (wheel.isReversed ? -1 : 1);
@@ -155,6 +268,7 @@ void SpectrumEditor::mouseWheelMove(const juce::MouseEvent& /*event*/, const juc
     
     scaleRefSpectrum(wheel.deltaY*dir);
     offsetRefSpectrum(wheel.deltaX*dir*offsetScrollGain);
+    invalidateRefSpectrum();
     repaint();
 }
 
@@ -163,10 +277,15 @@ void SpectrumEditor::mouseWheelMove(const juce::MouseEvent& /*event*/, const juc
 
 
 
-void SpectrumEditor::refreshPoints(bool ref, Spectrum::Peaks* peaks)
+void SpectrumEditor::refreshPoints(bool ref, const Spectrum::Peaks* peaks, const float* magnitudes)
 {
     juce::OwnedArray<SpectrumPoint>& points = ref ? refSpectrumPoints : spectrumPoints;
 
+    auto refreshPoint = [magnitudes] (SpectrumPoint* p, bool isPeak) {
+        if (magnitudes != nullptr) p->fromValue(magnitudes[p->index], isPeak);
+        else p->fromSpectrum(isPeak);
+    };
+
     // For marking peaks:
     if (peaks != nullptr && peaks->indexs.size() > 0)
     {
@@ -183,7 +302,7 @@ void SpectrumEditor::refreshPoints(bool ref, Spectrum::Peaks* peaks)
                 isPeak = true;
                 if (nPeaks > peakIndex) currentPeakIndex = peaks->indexs[peakIndex++];
             }
-            p->fromSpectrum(isPeak);
+            refreshPoint(p, isPeak);
         }
     }
     else // no peaks
@@ -191,9 +310,12 @@ void SpectrumEditor::refreshPoints(bool ref, Spectrum::Peaks* peaks)
         for (int i=0; i<points.size(); i++)
         {
             auto p = points[i];
-            p->fromSpectrum();
+            refreshPoint(p, false);
         }
     }
+
+    updateAllDisplayCoords(points);
+    if (ref) invalidateRefSpectrum();
 }
 
 void SpectrumEditor::multiplyAllPoints(double delta)
@@ -202,6 +324,7 @@ void SpectrumEditor::multiplyAllPoints(double delta)
     {
         point->updateMagnitude(point->magnitude * (float) delta);
     }
+    updateAllDisplayCoords(spectrumPoints);
 }
 
 void SpectrumEditor::initPoints()
@@ -213,6 +336,9 @@ void SpectrumEditor::initPoints()
         SpectrumPoint* point = new SpectrumPoint((int) i, spectrum);
         spectrumPoints.add(point);
     }
+    pointSelected = nullptr;
+    brushMagnitudes.reserve((size_t) spectrumPoints.size());
+    updateAllDisplayCoords(spectrumPoints);
 }
 
 void SpectrumEditor::clearSpectrum(bool ref)
@@ -220,6 +346,8 @@ void SpectrumEditor::clearSpectrum(bool ref)
     juce::OwnedArray<SpectrumPoint>& points = ref ? refSpectrumPoints : spectrumPoints;
 
     for (SpectrumPoint* p : points) p->updateMagnitude(0.0f);
+    updateAllDisplayCoords(points);
+    if (ref) invalidateRefSpectrum();
 }
 
 void SpectrumEditor::addRefSpectrum()
@@ -232,6 +360,53 @@ void SpectrumEditor::addRefSpectrum()
         SpectrumPoint* point = new SpectrumPoint((int) i, refSpectrum);
         refSpectrumPoints.add(point);
     }
+    updateAllDisplayCoords(refSpectrumPoints);
+    invalidateRefSpectrum();
+}
+juce::Range<float> SpectrumEditor::getVisibleRefFrequencyRange()
+{
+    // Invert the display mapping (see refIndexToX and renderRefSpectrumImage) at both edges:
+    const int nFreqs = refSpectrum.getNFreqs();
+    const float width = (float) getWidth();
+    auto xToFrequency = [this, nFreqs, width] (float x) {
+        const float unscaledX = (x - refDisplayOffset) / refDisplayScale - leftPadding;
+        if (refSpectrum.getAnalysisMode() == FFTSpectrum::AnalysisMode::ConstantQ)
+            return juce::jlimit(refSpectrum.getFrequency(0), refSpectrum.getFrequency(nFreqs - 1),
+                                spectrum.getFrequency(0) * (1.0f + unscaledX / width * spectrum.getNFreqs()));
+        return refSpectrum.getFrequency(juce::jlimit(0, nFreqs - 1, (int) (unscaledX / width * nFreqs)));
+    };
+    return {xToFrequency(0.0f), xToFrequency(width)};
+}
+void SpectrumEditor::resetRefDisplay()
+{
+    refDisplayOffset = 0.0f;
+    refDisplayScale = 1.0f;
+    invalidateRefSpectrum();
+}
+void SpectrumEditor::refreshRefAxis()
+{
+    updateAllDisplayCoords(refSpectrumPoints);
+    invalidateRefSpectrum();
+}
+bool SpectrumEditor::alignRefToHarmonics(float fundamental)
+{
+    const int nRef = refSpectrum.getNFreqs();
+    if (fundamental <= 0.0f || nRef < 2) return false;
+
+    // Reference point j is at refIndexToX(j)*scale + offset, and partial i (at fundamental*(i+1)) at
+    // i/nPartials*width + leftPadding. Both are linear in frequency, so match them at the first and
+    // last bins:
+    const float width = (float) getWidth();
+    auto partialX = [&] (float frequency) {return (frequency / fundamental - 1.0f) / spectrum.getNFreqs() * width + leftPadding;};
+    const float firstX = refIndexToX(0);
+    const float lastX = refIndexToX(nRef - 1);
+    const float firstTarget = partialX(refSpectrum.getFrequency(0));
+    const float lastTarget = partialX(refSpectrum.getFrequency(nRef - 1));
+
+    refDisplayScale = (lastTarget - firstTarget) / (lastX - firstX);
+    refDisplayOffset = firstTarget - refDisplayScale * firstX;
+    invalidateRefSpectrum();
+    return true;
 }
 inline void SpectrumEditor::offsetRefSpectrum(float delta)
 {
@@ -256,15 +431,51 @@ inline float  SpectrumEditor::coordsToMagnitude(const juce::Point<float>& point)
 {
     return 1.0f - (point.y-topPadding)/(getHeight()-bottomPadding-topPadding);
 }
+// Reference points are spaced by bin index, except constant-Q bins (log spaced), which are placed by
+// frequency on the partials' axis so that the harmonics of the note sit under the partials:
+float SpectrumEditor::refIndexToX(int index)
+{
+    const float width = (float) getWidth();
+    if (refSpectrum.getAnalysisMode() == FFTSpectrum::AnalysisMode::ConstantQ)
+        return (refSpectrum.getFrequency(index) / spectrum.getFrequency(0) - 1.0f) / spectrum.getNFreqs() * width + leftPadding;
+    return ((float) index / refSpectrum.getNFreqs()) * width + leftPadding;
+}
 inline void  SpectrumEditor::updateDisplayCoords(SpectrumPoint* point)
 {
-    point->displayCoords.x = ((float) point->index/point->spectrum.getNFreqs()) * getWidth() + leftPadding;
+    point->displayCoords.x = &point->spectrum == &refSpectrum ? refIndexToX(point->index)
+                           : ((float) point->index/point->spectrum.getNFreqs()) * getWidth() + leftPadding;
     point->displayCoords.y = topPadding + (1.0f - point->magnitude)*(getHeight()-bottomPadding-topPadding);
 }
+void SpectrumEditor::updateAllDisplayCoords(juce::OwnedArray<SpectrumPoint>& points)
+{
+    for (SpectrumPoint* p : points) updateDisplayCoords(p);
+}
 
 inline bool  SpectrumEditor::inBoundary(const juce::Point<float>& circleCenter, const juce::Point<float>& testPoint)
 {
-    return abs(circleCenter.x - testPoint.x) < boundaryRadius;
+    return std::abs(circleCenter.x - testPoint.x) < pickRadius;
+}
+
+// Inverse of updateDisplayCoords for the additive spectrum points (nearest index, may be out of range):
+inline int SpectrumEditor::xToIndex(float x)
+{
+    return juce::roundToInt((x - leftPadding) * (float) spectrumPoints.size() / (float) getWidth());
+}
+
+SpectrumEditor::SpectrumPoint* SpectrumEditor::pointAt(const juce::Point<float>& position)
+{
+    if (spectrumPoints.isEmpty() || getWidth() <= 0) return nullptr;
+
+    int index = xToIndex(position.x);
+    if (index < 0 || index >= spectrumPoints.size()) return nullptr;
+
+    SpectrumPoint* point = spectrumPoints.getUnchecked(index);
+    return inBoundary(point->displayCoords, position) ? point : nullptr;
+}
+
+void SpectrumEditor::setPickRadius(float radius)
+{
+    pickRadius = juce::jmax(0.0f, radius);
 }
 
 
@@ -285,20 +496,25 @@ SpectrumEditor::SpectrumPoint::SpectrumPoint(int i, Spectrum& spectrum)
     fromSpectrum();
 }
 
-inline void SpectrumEditor::SpectrumPoint::updateMagnitude(float mag)
+inline void SpectrumEditor::SpectrumPoint::updateMagnitude(float mag, bool updateSpectrum)
 {
     // Threshold:
     if (mag < 0.0f) mag = 0.0f;
     else if (mag > 1.0f) mag = 1.0f;
 
     magnitude = mag;
-    spectrum.setMagnitude(index, mag);
+    if (updateSpectrum) spectrum.setMagnitude(index, mag);
 }
 inline void SpectrumEditor::SpectrumPoint::fromSpectrum(bool isPeak)
 {
     magnitude = spectrum.getMagnitude(index);
     marked = isPeak;
 }
+inline void SpectrumEditor::SpectrumPoint::fromValue(float mag, bool isPeak)
+{
+    magnitude = mag;
+    marked = isPeak;
+}
    
 inline float SpectrumEditor::SpectrumPoint::getFrequency()
 {
@@ -13,18 +13,28 @@ public:
     SpectrumEditor(AdditiveSpectrum& spectrum, FFTSpectrum& refSpectrum);
 
     void paint (juce::Graphics& g) override;
+    void resized() override;
 
     void mouseUp (const juce::MouseEvent& event) override;
     void mouseDrag (const juce::MouseEvent& event) override;
     void mouseWheelMove(const juce::MouseEvent& event, const juce::MouseWheelDetails& wheel) override;
 
-    void refreshPoints(bool ref = false, Spectrum::Peaks* peaks = nullptr);
+    // Reads point magnitudes from the spectrum, or from magnitudes (one per point) if given
+    void refreshPoints(bool ref = false, const Spectrum::Peaks* peaks = nullptr, const float* magnitudes = nullptr);
     void multiplyAllPoints(double delta);
     void initPoints();
 
     void clearSpectrum(bool ref = false);
 
     void addRefSpectrum();
+    juce::Range<float> getVisibleRefFrequencyRange(); // after scrolling/zooming the reference
+    void resetRefDisplay();
+    void refreshRefAxis(); // after the note changes, which moves constant-Q reference points
+    // Scales and offsets the reference so that its multiples of fundamental sit under the partials
+    // (which play the harmonics)
+    bool alignRefToHarmonics(float fundamental);
+
+    void setPickRadius(float radius); // Horizontal distance (in pixels) within which a partial can be picked
     
 private:
     struct SpectrumPoint
@@ -37,8 +47,9 @@ private:
         bool marked;
         Spectrum& spectrum;
 
-        inline void updateMagnitude(float mag);
+        inline void updateMagnitude(float mag, bool updateSpectrum = true);
         inline void fromSpectrum(bool isPeak = false);
+        inline void fromValue(float mag, bool isPeak = false);
         inline float getFrequency();
     };
     
@@ -46,17 +57,39 @@ private:
     juce::OwnedArray<SpectrumPoint> refSpectrumPoints;
     inline float coordsToMagnitude(const juce::Point<float>& point);
     inline void updateDisplayCoords(SpectrumPoint* point);
+    float refIndexToX(int index);
+    void updateAllDisplayCoords(juce::OwnedArray<SpectrumPoint>& points);
     inline void scaleRefSpectrum(float delta);
     inline void offsetRefSpectrum(float delta);
     
-    // Point selected:
+    // Point selected (kept for the whole drag, so the selection doesn't jump between neighbours):
     SpectrumPoint* pointSelected = nullptr;
+    inline int xToIndex(float x);
+    SpectrumPoint* pointAt(const juce::Point<float>& position);
+
+    // Shift-dragging brushes over every partial swept since the last drag event:
+    bool brushing = false;
+    juce::Point<float> lastBrushPosition;
+    std::vector<float> brushMagnitudes;
+    void brushPoints(const juce::Point<float>& position);
 
     const float topPadding = 20.0f;
     const float bottomPadding = 10.0f;
     const float leftPadding = 7.0f;
     const float boundaryRadius = 2.5f;
+    float pickRadius = boundaryRadius;
     inline bool inBoundary(const juce::Point<float>& circleCenter, const juce::Point<float>& testPoint);
+
+    // Editing a point only repaints the column strip around it (wide enough for its frequency label):
+    const float pointStripHalfWidth = 21.0f;
+    void repaintPoint(SpectrumPoint* point);
+
+    // Reference spectrum is rasterised once and redrawn from this cache until it changes:
+    juce::Image refSpectrumImage;
+    bool refSpectrumImageValid = false;
+    std::vector<float> refColumnTop, refColumnBottom; // min/max y per pixel column
+    void renderRefSpectrumImage();
+    void invalidateRefSpectrum();
     
     AdditiveSpectrum& spectrum;
     FFTSpectrum& refSpectrum;
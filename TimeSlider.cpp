@@ -5,14 +5,14 @@
 #include "TimeSlider.h"
 #include "AdditiveSpectrum.h"
 #include "SpectrumEditor.h"
+#include "Tracer.h"
 
 TimeSlider::TimeSlider(AdditiveSpectrum& spectrum, SpectrumEditor& spectrumEditor)
     : spectrum(spectrum), spectrumEditor(spectrumEditor),
-      playSamplePeriod(spectrum.getDuration()/(4*(spectrum.getNKeyFrames())) ),
       playerTimer(this)
 {
     spectrum.updateKeyFrameTimes(keyFrameTimes);
-    spectrum.timeSlider = this;
+    spectrum.onKeyFramesChanged = [this] {refreshKeyFrameMarkers();};
 }
 
 void TimeSlider::paint (juce::Graphics& g) 
@@ -144,34 +144,20 @@ TimeSlider::PlayerTimer::PlayerTimer(TimeSlider* tS)
 {
     spectrum = &tS->spectrum;
     timeSlider = tS;
-    timerInterval = juce::roundToInt<float>(tS->playSamplePeriod*1000);
 }
 
 void TimeSlider::PlayerTimer::timerCallback()
 {
-    float time = spectrum->getTime();
-    float duration = spectrum->getDuration();
+    ADDRSOUND_TRACE_SCOPE("PlayerTimer::timerCallback");
 
-    if(time + timeSlider->playSamplePeriod < duration)
-    {
-        time += timeSlider->playSamplePeriod;
-        spectrum->setTime(time);
-    }
-    else
-    {
+    // The audio thread stops playback once it reaches the end of the spectrum:
+    if (spectrum->getPlayState() != AdditiveSpectrum::PlayState::PlayingSound)
         stopTimer();
-        spectrum->setPlayState(AdditiveSpectrum::PlayState::Stopped);
-    }
     timeSlider->repaintAll();
 }
 void TimeSlider::PlayerTimer::play()
 {   
-    if (spectrum->getPlayState() == AdditiveSpectrum::PlayState::PlayingSound)
-    {
-        stopTimer();
-    }
-    spectrum->setTime(0.0f);
-    spectrum->setPlayState(AdditiveSpectrum::PlayState::PlayingSound);
-    startTimer(timerInterval);
+    spectrum->play(0.0f); // Restarts rather than stopping first, which the audio thread could undo
+    startTimerHz(refreshRateHz);
     timeSlider->repaintAll();
 }
\ No newline at end of file
@@ -28,11 +28,11 @@ private:
     const float circleRadius= 6.0f;
     const float keyFrameThickness = 2.0f;
 
-    const float playSamplePeriod;// in seconds
     juce::Array<float> keyFrameTimes;
 
     AdditiveSpectrum& spectrum;
     SpectrumEditor& spectrumEditor;
+    // Playback time is advanced by the audio thread; this timer only redraws the cursor whilst playing.
     class PlayerTimer : juce::Timer
     {
     public:
@@ -41,7 +41,7 @@ private:
         void play();
         TimeSlider* timeSlider;
         AdditiveSpectrum* spectrum;
-        int timerInterval;
+        const int refreshRateHz = 30;
     } playerTimer;
 
 
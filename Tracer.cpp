@@ -0,0 +1,181 @@
+#include <juce_events/juce_events.h>
+
+#include "Tracer.h"
+
+Tracer& Tracer::getInstance()
+{
+    static Tracer tracer;
+    return tracer;
+}
+
+Tracer::Tracer()
+    : juce::Thread("Trace Flush"), originTicks(0), firstEventWritten(false) {}
+
+Tracer::~Tracer()
+{
+    stop();
+}
+
+void Tracer::start(const juce::File& outputFile)
+{
+    if (recording.load()) return;
+
+    // Buffers are allocated once and kept, as traced threads hold on to their claimed buffer:
+    if (buffers == nullptr) buffers.reset(new ThreadBuffer[maxThreads]);
+    for (size_t slot = 0; slot < maxThreads; slot++)
+    {
+        auto& buffer = buffers[slot];
+        buffer.readIndex.store(buffer.writeIndex.load());
+        buffer.dropped.store(0);
+        buffer.nameWritten = false;
+        if (buffer.released.load()) releaseBuffer(buffer); // Exited whilst nothing was draining
+    }
+
+    output.reset(new juce::FileOutputStream(outputFile));
+    if (! output->openedOk())
+    {
+        DBG("Could not open trace file " + outputFile.getFullPathName());
+        output = nullptr;
+        return;
+    }
+    output->setPosition(0);
+    output->truncate();
+    *output << "{\"traceEvents\":[\n";
+    firstEventWritten = false;
+    originTicks = juce::Time::getHighResolutionTicks();
+
+    recording.store(true);
+    startThread(2);
+    juce::Logger::writeToLog("Tracing to " + outputFile.getFullPathName());
+}
+
+void Tracer::stop()
+{
+    if (! recording.exchange(false)) return;
+
+    stopThread(1000);
+    drainBuffers(); // Pick up anything recorded since the last flush
+
+    *output << "\n]}\n";
+    output->flush();
+    output = nullptr;
+
+    for (size_t slot = 0; slot < maxThreads; slot++)
+    {
+        auto dropped = buffers[slot].dropped.load();
+        if (dropped > 0)
+        {
+            DBG("Trace thread " + juce::String(buffers[slot].tid) + " dropped " + juce::String(dropped) + " events");
+        }
+    }
+}
+
+void Tracer::record(const char* name, juce::int64 startTicks, juce::int64 endTicks) noexcept
+{
+    if (! recording.load(std::memory_order_relaxed)) return;
+
+    thread_local BufferOwner owner;
+    if (owner.buffer == nullptr)
+    {
+        owner.buffer = claimBuffer(); // Retried while every buffer is taken, as exiting threads free theirs
+        if (owner.buffer == nullptr) return;
+    }
+    ThreadBuffer* buffer = owner.buffer;
+
+    auto write = buffer->writeIndex.load(std::memory_order_relaxed);
+    if (write - buffer->readIndex.load(std::memory_order_acquire) >= (juce::uint32) ThreadBuffer::capacity)
+    {
+        buffer->dropped.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+    buffer->events[write & (ThreadBuffer::capacity - 1)] = {name, startTicks, endTicks};
+    buffer->writeIndex.store(write + 1, std::memory_order_release);
+}
+
+Tracer::ThreadBuffer* Tracer::claimBuffer() noexcept
+{
+    for (size_t slot = 0; slot < maxThreads; slot++)
+    {
+        auto& buffer = buffers[slot];
+        bool expected = false;
+        if (! buffer.claimed.load(std::memory_order_relaxed)
+            && buffer.claimed.compare_exchange_strong(expected, true, std::memory_order_acquire))
+        {
+            // Published to the flush thread by the first release store of writeIndex
+            buffer.tid = nextTid++;
+            buffer.threadName[0] = 0;
+            if (auto* thread = juce::Thread::getCurrentThread())
+                thread->getThreadName().copyToUTF8(buffer.threadName, sizeof(buffer.threadName));
+            else if (juce::MessageManager::existsAndIsCurrentThread())
+                juce::String("Message Thread").copyToUTF8(buffer.threadName, sizeof(buffer.threadName));
+            return &buffer;
+        }
+    }
+    return nullptr;
+}
+
+// Called by the flush thread (or with it stopped) once everything the exited thread wrote is drained
+void Tracer::releaseBuffer(ThreadBuffer& buffer) noexcept
+{
+    buffer.nameWritten = false;
+    buffer.released.store(false, std::memory_order_relaxed);
+    buffer.claimed.store(false, std::memory_order_release);
+}
+
+void Tracer::run()
+{
+    while (! threadShouldExit())
+    {
+        wait(100);
+        drainBuffers();
+    }
+}
+
+void Tracer::drainBuffers()
+{
+    auto ticksToMicroseconds = [this] (juce::int64 ticks) {
+        return juce::Time::highResolutionTicksToSeconds(ticks - originTicks) * 1.0e6;
+    };
+    auto writeEvent = [this] (const juce::String& json) {
+        if (firstEventWritten) *output << ",\n";
+        *output << json;
+        firstEventWritten = true;
+    };
+
+    for (size_t slot = 0; slot < maxThreads; slot++)
+    {
+        auto& buffer = buffers[slot];
+        if (! buffer.claimed.load(std::memory_order_acquire)) continue;
+
+        // Read before writeIndex, so every event written before the thread exited gets drained:
+        const bool released = buffer.released.load(std::memory_order_acquire);
+        auto write = buffer.writeIndex.load(std::memory_order_acquire);
+        auto read = buffer.readIndex.load(std::memory_order_relaxed);
+
+        if (read != write && ! buffer.nameWritten)
+        {
+            writeEvent("{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" + juce::String(buffer.tid)
+                       + ",\"args\":{\"name\":\"" + getThreadName(buffer) + "\"}}");
+            buffer.nameWritten = true;
+        }
+
+        for (; read != write; read++)
+        {
+            const Event& event = buffer.events[read & (ThreadBuffer::capacity - 1)];
+            auto start = ticksToMicroseconds(event.startTicks);
+            auto end = ticksToMicroseconds(event.endTicks);
+            writeEvent("{\"name\":\"" + juce::String(event.name) + "\",\"ph\":\"X\",\"pid\":1,\"tid\":" + juce::String(buffer.tid)
+                       + ",\"ts\":" + juce::String(start, 3) + ",\"dur\":" + juce::String(end - start, 3) + "}");
+        }
+        buffer.readIndex.store(read, std::memory_order_release);
+
+        if (released) releaseBuffer(buffer);
+    }
+    output->flush();
+}
+
+juce::String Tracer::getThreadName(const ThreadBuffer& buffer)
+{
+    if (buffer.threadName[0] != 0) return juce::String::fromUTF8(buffer.threadName);
+    return "Thread " + juce::String(buffer.tid);
+}
@@ -0,0 +1,88 @@
+#pragma once
+
+#include <juce_core/juce_core.h>
+
+// Tracing is compiled out unless the build defines ADDRSOUND_TRACING=1 (cmake -DADDRSOUND_TRACING=ON)
+#ifndef ADDRSOUND_TRACING
+ #define ADDRSOUND_TRACING 0
+#endif
+
+#if ADDRSOUND_TRACING
+ #define ADDRSOUND_TRACE_SCOPE(name) Tracer::ScopedEvent JUCE_JOIN_MACRO(traceEvent_, __LINE__) (name)
+#else
+ #define ADDRSOUND_TRACE_SCOPE(name)
+#endif
+
+// Records scoped events from any thread into per-thread lock-free buffers. A background
+// thread drains them into a Chrome trace JSON file (open with chrome://tracing or Perfetto).
+class Tracer : private juce::Thread
+{
+public:
+    static Tracer& getInstance();
+
+    void start(const juce::File& outputFile);
+    void stop();
+
+    // Called from the traced thread. Never allocates or locks; drops the event if the buffer is full.
+    void record(const char* name, juce::int64 startTicks, juce::int64 endTicks) noexcept;
+
+    class ScopedEvent
+    {
+    public:
+        ScopedEvent(const char* eventName) noexcept
+            : name(eventName), startTicks(juce::Time::getHighResolutionTicks()) {}
+        ~ScopedEvent() {Tracer::getInstance().record(name, startTicks, juce::Time::getHighResolutionTicks());}
+
+    private:
+        const char* name;
+        const juce::int64 startTicks;
+    };
+
+private:
+    Tracer();
+    ~Tracer() override;
+
+    void run() override;
+    void drainBuffers();
+
+    struct Event
+    {
+        const char* name; // must be a string literal
+        juce::int64 startTicks;
+        juce::int64 endTicks;
+    };
+
+    // Single producer (the owning thread), single consumer (the flush thread)
+    struct ThreadBuffer
+    {
+        static constexpr int capacity = 1 << 14; // must be power of 2
+        std::array<Event, capacity> events;
+        std::atomic<juce::uint32> writeIndex {0};
+        std::atomic<juce::uint32> readIndex {0};
+        std::atomic<juce::uint32> dropped {0};
+        std::atomic<bool> claimed {false};
+        std::atomic<bool> released {false}; // owning thread exited; freed by the flush thread once drained
+        int tid = 0; // in the trace, unique to each claim
+        char threadName[64] = {}; // copied when claimed, as the thread may be gone when it's drained
+        bool nameWritten = false;
+    };
+    ThreadBuffer* claimBuffer() noexcept;
+    void releaseBuffer(ThreadBuffer& buffer) noexcept;
+    juce::String getThreadName(const ThreadBuffer& buffer);
+
+    // Hands a thread's buffer back when the thread exits
+    struct BufferOwner
+    {
+        ThreadBuffer* buffer = nullptr;
+        ~BufferOwner() {if (buffer != nullptr) buffer->released.store(true, std::memory_order_release);}
+    };
+
+    static constexpr size_t maxThreads = 16;
+    std::unique_ptr<ThreadBuffer[]> buffers;
+    std::atomic<bool> recording {false};
+    std::atomic<int> nextTid {0};
+
+    std::unique_ptr<juce::FileOutputStream> output;
+    juce::int64 originTicks;
+    bool firstEventWritten;
+};
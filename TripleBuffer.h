@@ -0,0 +1,46 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+
+// Wait-free exchange of the latest value from one producer thread to one consumer thread.
+// The producer fills getWriteBuffer() then publish()es it; the consumer calls update() and reads
+// getReadBuffer(). Neither side ever blocks or allocates, and intermediate values are dropped.
+template <typename T>
+class TripleBuffer
+{
+public:
+    TripleBuffer() : middle(2), writeIndex(0), readIndex(1) {}
+
+    // Producer:
+    T& getWriteBuffer() noexcept {return buffers[(size_t) writeIndex];}
+    void publish() noexcept
+    {
+        writeIndex = middle.exchange(writeIndex | dirtyFlag, std::memory_order_acq_rel) & indexMask;
+    }
+
+    // Consumer: returns true if a newer value has been published since the last update
+    bool update() noexcept
+    {
+        if ((middle.load(std::memory_order_relaxed) & dirtyFlag) == 0) return false;
+        readIndex = middle.exchange(readIndex, std::memory_order_acq_rel) & indexMask;
+        return true;
+    }
+    const T& getReadBuffer() const noexcept {return buffers[(size_t) readIndex];}
+
+    // Only whilst neither producer nor consumer are running, e.g. to preallocate every buffer
+    template <typename Function>
+    void forEachBuffer(Function&& f)
+    {
+        for (auto& buffer : buffers) f(buffer);
+    }
+
+private:
+    static constexpr int dirtyFlag = 4;
+    static constexpr int indexMask = 3;
+
+    std::array<T, 3> buffers;
+    std::atomic<int> middle; // index of the buffer in the middle, plus dirtyFlag when it holds unread data
+    int writeIndex;
+    int readIndex;
+};
@@ -1,11 +1,11 @@
 #pragma once
 
-#include <juce_audio_utils/juce_audio_utils.h>
+#include <juce_audio_basics/juce_audio_basics.h>
 
 class WavetableOscillator {
 public:
-    WavetableOscillator(const juce::AudioSampleBuffer& waveTableToUse, const juce::AudioSampleBuffer& squareWaveTableToUse, float sampleRate)
-       : sineWavetable(waveTableToUse), squareWavetable(squareWaveTableToUse), tableSize(sineWavetable.getNumSamples() - 1), fs(sampleRate),
+    WavetableOscillator(const juce::AudioSampleBuffer& waveTableToUse, float sampleRate)
+       : sineWavetable(waveTableToUse), tableSize(sineWavetable.getNumSamples() - 1), fs(sampleRate),
          vibratoDelta(10 /*Hz*/ * ((float) tableSize / fs))
     {
         jassert(sineWavetable.getNumChannels() == 1);
@@ -13,27 +13,53 @@ public:
 
     void setFrequency(float freq)
     {
-        tableDelta = freq * ((float) tableSize / fs);
+        tableDelta = targetDelta = freq * ((float) tableSize / fs);
+        rampSamples = 0;
     }
 
     void setAmplitude(float a)
     {
-        amplitude = a;
+        amplitude = targetAmplitude = a;
+        rampSamples = 0;
     }
 
-    void setVibratoFactor(std::atomic<double>* vibrato)
+    // Glides linearly from the current frequency and amplitude to the given ones over numSamples,
+    // keeping the phase continuous. A silent oscillator starts at the new frequency straight away.
+    void glideTo(float freq, float a, int numSamples)
     {
-        vibratoFactor = vibrato;
+        const float delta = freq * ((float) tableSize / fs);
+        if (amplitude == 0.0f && rampSamples == 0) tableDelta = delta;
+        targetDelta = delta;
+        targetAmplitude = a;
+        rampSamples = juce::jmax(1, numSamples);
+        deltaStep = (targetDelta - tableDelta) / (float) rampSamples;
+        amplitudeStep = (targetAmplitude - amplitude) / (float) rampSamples;
     }
 
-    void setDistortionFactor(std::atomic<double>* distortion)
+    float getTargetFrequency() const {return targetDelta * (fs / (float) tableSize);}
+    float getTargetAmplitude() const {return targetAmplitude;}
+
+    void setVibratoFactor(std::atomic<double>* vibrato)
     {
-        distortionFactor = distortion;
+        vibratoFactor = vibrato;
     }
 
     forcedinline float getNextSample() noexcept
     {
-        if (amplitude == 0.0f) return 0.0f;
+        if (rampSamples > 0)
+        {
+            if (--rampSamples == 0) // Land exactly on the targets
+            {
+                tableDelta = targetDelta;
+                amplitude = targetAmplitude;
+            }
+            else
+            {
+                tableDelta += deltaStep;
+                amplitude += amplitudeStep;
+            }
+        }
+        else if (amplitude == 0.0f) return 0.0f;
         
         auto index0 = (unsigned int) currentIndex;
         auto index1 = index0 + 1;
@@ -43,13 +69,6 @@ public:
         auto value0 = table[index0];
         auto value1 = table[index1];
 
-        if(distortionFactor && *distortionFactor)
-        {
-            auto* squareTable = squareWavetable.getReadPointer(0);
-            value0 = (1-(float)*distortionFactor) * value0 + (float)*distortionFactor * squareTable[index0];
-            value1 = (1-(float)*distortionFactor) * value1 + (float)*distortionFactor * squareTable[index1];
-        }
-
         auto delta = tableDelta;
 
         if (vibratoFactor && *vibratoFactor)
@@ -74,16 +93,20 @@ public:
 
 private:
     const juce::AudioSampleBuffer& sineWavetable;
-    const juce::AudioSampleBuffer& squareWavetable;
     const int tableSize;
     const float fs;
     float amplitude = 1.0f;
     float currentIndex = 0.0f;
     float tableDelta = 0.0f;
 
+    // Glide (see glideTo):
+    float targetAmplitude = 1.0f;
+    float targetDelta = 0.0f;
+    float amplitudeStep = 0.0f;
+    float deltaStep = 0.0f;
+    int rampSamples = 0;
+
     std::atomic<double>* vibratoFactor;
     const float vibratoDelta;
     float vibratoIndex = 0.0f;
-
-    std::atomic<double>* distortionFactor;
 };
\ No newline at end of file